@@ -7,6 +7,8 @@
  * - Seam carving parameters (width/height reduction)
  * - WebAssembly module integration
  * - Image processing and download
+ * - Live overlay of the seams being removed
+ * - Energy and cumulative cost heatmap views of the original
  *
  * Dependencies:
  * - React hooks (useState, useEffect, useRef)
@@ -24,6 +26,7 @@ import { loadWasm, getWasmModule } from "./loadWasm";
 import {
   calculateSeamsToRemove,
   validateSeamReduction,
+  drawSeams,
 } from "./utils/seamUtils";
 
 function App() {
@@ -35,7 +38,12 @@ function App() {
   const [widthReductionPercent, setWidthReductionPercent] = useState(30);
   const [heightReductionPercent, setHeightReductionPercent] = useState(0);
   const [seamReductionDetails, setSeamReductionDetails] = useState(null);
-  const canvasRef = useRef(null);
+  const [showSeams, setShowSeams] = useState(true);
+  const [view, setView] = useState("image");
+  const [heatmap, setHeatmap] = useState(null);
+  const processedCanvasRef = useRef(null);
+  const heatmapCanvasRef = useRef(null);
+  const overlayCanvasRef = useRef(null);
   const downloadLinkRef = useRef(null);
   const fileInputRef = useRef(null);
 
@@ -85,25 +93,26 @@ function App() {
     }
   }, [originalImage, widthReductionPercent, heightReductionPercent]);
 
-  const handleImageUpload = (e) => {
+  const handleImageUpload = async (e) => {
     const file = e.target.files[0];
     if (!file) return;
 
     setError(null);
     setProcessedImage(null);
+    // Clear the seams drawn over the previous image
+    if (overlayCanvasRef.current) overlayCanvasRef.current.width = 0;
 
-    const reader = new FileReader();
-    reader.onload = (event) => {
-      const img = new Image();
-      img.onload = () => {
-        setOriginalImage(img);
-      };
-      img.onerror = () => {
-        setError("Failed to load image. Please try a different file.");
-      };
-      img.src = event.target.result;
-    };
-    reader.readAsDataURL(file);
+    try {
+      // Decoding happens in the carving worker; the <img> preview streams the
+      // file through an object URL instead of a data URL
+      const { width, height } = await getWasmModule().decodeImage(file);
+      setOriginalImage((previous) => {
+        if (previous) URL.revokeObjectURL(previous.src);
+        return { src: URL.createObjectURL(file), width, height };
+      });
+    } catch (err) {
+      setError("Failed to load image. Please try a different file.");
+    }
   };
 
   const processImage = async () => {
@@ -126,105 +135,112 @@ function App() {
       setIsProcessing(true);
       setError(null);
 
-      // Create a canvas to get image data
-      const canvas = document.createElement("canvas");
-      canvas.width = originalImage.width;
-      canvas.height = originalImage.height;
-      const ctx = canvas.getContext("2d");
-      ctx.drawImage(originalImage, 0, 0);
-      const imageData = ctx.getImageData(0, 0, canvas.width, canvas.height);
-
-      // In a real implementation, we would call our WASM functions here
-      // For now, we'll just simulate processing with a timeout
-      setTimeout(() => {
-        try {
-          // Extract the number of seams to remove from our calculations
-          const { verticalSeamsToRemove, horizontalSeamsToRemove } =
-            seamReductionDetails;
-
-          // Use vertical seams (width reduction) in this example
-          // In a real implementation, we would handle both vertical and horizontal seams
-          const processedData = simulateSeamCarving(
-            imageData,
-            verticalSeamsToRemove
-          );
-
-          // Create a new image from the processed data
-          const processedCanvas = document.createElement("canvas");
-          processedCanvas.width = imageData.width - verticalSeamsToRemove;
-          processedCanvas.height = imageData.height;
-          const processedCtx = processedCanvas.getContext("2d");
-          processedCtx.putImageData(processedData, 0, 0);
-
-          const processedImg = new Image();
-          processedImg.onload = () => {
-            setProcessedImage(processedImg);
-            setIsProcessing(false);
-          };
-          processedImg.src = processedCanvas.toDataURL("image/png");
-        } catch (err) {
-          setError("Error during image processing: " + err.message);
-          setIsProcessing(false);
+      // Use vertical seams (width reduction) for now
+      const { verticalSeamsToRemove } = seamReductionDetails;
+
+      // Seams stream in as compact paths and are drawn over the original as
+      // they are removed; only the final image is transferred as pixels
+      const overlay = overlayCanvasRef.current;
+      let onSeams = null;
+      if (overlay) {
+        overlay.width = originalImage.width;
+        overlay.height = originalImage.height;
+        const overlayCtx = overlay.getContext("2d");
+        if (showSeams) {
+          onSeams = ({ starts, steps }) =>
+            drawSeams(overlayCtx, starts, steps, originalImage.height);
         }
-      }, 1500); // Simulate processing time
+      }
+
+      // The worker hands back an ImageBitmap of the result; encoding is
+      // deferred until the user downloads it
+      const { bitmap, width, height } = await getWasmModule().carveImage(
+        verticalSeamsToRemove,
+        {},
+        onSeams
+      );
+      setProcessedImage({ bitmap, width, height });
+      setIsProcessing(false);
     } catch (err) {
-      setError("Error preparing image for processing: " + err.message);
+      setError("Error during image processing: " + err.message);
       setIsProcessing(false);
     }
   };
 
-  // Simulation function (will be replaced with real WASM call)
-  const simulateSeamCarving = (imageData, seamCount) => {
-    // Create a new ImageData with reduced width
-    const newWidth = imageData.width - seamCount;
-    const newImageData = new ImageData(newWidth, imageData.height);
-
-    // Simple algorithm to simulate seam carving by removing columns
-    // In a real implementation, this would be done by the C code via WebAssembly
-    for (let y = 0; y < imageData.height; y++) {
-      for (let x = 0; x < newWidth; x++) {
-        // Remove evenly spaced columns (this is just a simplistic visual simulation)
-        // In real seam carving, we would remove the lowest energy seams
-        const sourceX = Math.floor(x * (imageData.width / newWidth));
-
-        const sourceIndex = (y * imageData.width + sourceX) * 4;
-        const targetIndex = (y * newWidth + x) * 4;
-
-        newImageData.data[targetIndex] = imageData.data[sourceIndex]; // R
-        newImageData.data[targetIndex + 1] = imageData.data[sourceIndex + 1]; // G
-        newImageData.data[targetIndex + 2] = imageData.data[sourceIndex + 2]; // B
-        newImageData.data[targetIndex + 3] = imageData.data[sourceIndex + 3]; // A
-      }
-    }
+  // Fetch a heatmap preview of the original when one of those views is shown
+  useEffect(() => {
+    setHeatmap(null);
+    if (!wasmLoaded || !originalImage || view === "image") return;
+
+    let cancelled = false;
+    getWasmModule()
+      .heatmapImage(view)
+      .then((preview) => {
+        if (cancelled) {
+          preview.bitmap.close();
+        } else {
+          setHeatmap(preview);
+        }
+      })
+      .catch((err) => setError("Error computing heatmap: " + err.message));
+    return () => {
+      cancelled = true;
+    };
+  }, [wasmLoaded, originalImage, view]);
 
-    return newImageData;
-  };
+  useEffect(() => {
+    const canvas = heatmapCanvasRef.current;
+    if (!canvas || !heatmap) return;
 
-  const handleDownload = () => {
-    if (!processedImage) return;
+    canvas.width = heatmap.width;
+    canvas.height = heatmap.height;
+    canvas.getContext("bitmaprenderer").transferFromImageBitmap(heatmap.bitmap);
+  }, [heatmap]);
+
+  // Paint the carved result straight from its ImageBitmap
+  useEffect(() => {
+    const canvas = processedCanvasRef.current;
+    if (!canvas || !processedImage) return;
 
-    // Create a canvas with the processed image
-    const canvas = document.createElement("canvas");
     canvas.width = processedImage.width;
     canvas.height = processedImage.height;
-    const ctx = canvas.getContext("2d");
-    ctx.drawImage(processedImage, 0, 0);
-
-    // Create a download link
-    if (downloadLinkRef.current) {
-      downloadLinkRef.current.href = canvas.toDataURL("image/png");
-      downloadLinkRef.current.download = "seam-carved-image.png";
-      downloadLinkRef.current.click();
+    canvas.getContext("bitmaprenderer").transferFromImageBitmap(
+      processedImage.bitmap
+    );
+  }, [processedImage]);
+
+  const handleDownload = async () => {
+    if (!processedImage) return;
+
+    try {
+      // The PNG is encoded asynchronously inside the worker
+      const blob = await getWasmModule().encodeImage("image/png");
+      const url = URL.createObjectURL(blob);
+
+      // Create a download link
+      if (downloadLinkRef.current) {
+        downloadLinkRef.current.href = url;
+        downloadLinkRef.current.download = "seam-carved-image.png";
+        downloadLinkRef.current.click();
+      }
+      setTimeout(() => URL.revokeObjectURL(url), 0);
+    } catch (err) {
+      setError("Error encoding image: " + err.message);
     }
   };
 
   const handleReset = () => {
+    if (originalImage) {
+      URL.revokeObjectURL(originalImage.src);
+      getWasmModule().releaseImage();
+    }
     setOriginalImage(null);
     setProcessedImage(null);
     setError(null);
     setWidthReductionPercent(30);
     setHeightReductionPercent(0);
     setSeamReductionDetails(null);
+    setView("image");
 
     // Reset file input
     if (fileInputRef.current) {
@@ -374,6 +390,15 @@ function App() {
                 </div>
               )}
 
+              <label className="flex items-center gap-2 text-sm text-gray-700">
+                <input
+                  type="checkbox"
+                  checked={showSeams}
+                  onChange={(e) => setShowSeams(e.target.checked)}
+                />
+                Show removed seams on the original
+              </label>
+
               <button
                 onClick={processImage}
                 disabled={
@@ -404,13 +429,39 @@ function App() {
             <div className="grid grid-cols-1 md:grid-cols-2 gap-6">
               {originalImage && (
                 <div>
-                  <h3 className="text-lg font-semibold mb-2">Original Image</h3>
+                  <div className="flex items-center justify-between mb-2">
+                    <h3 className="text-lg font-semibold">Original Image</h3>
+                    <select
+                      value={view}
+                      onChange={(e) => setView(e.target.value)}
+                      className="text-sm border border-gray-300 rounded-md px-2 py-1"
+                    >
+                      <option value="image">Image</option>
+                      <option value="energy">Energy</option>
+                      <option value="cost">Cumulative cost</option>
+                    </select>
+                  </div>
                   <div className="border border-gray-300 rounded-md overflow-hidden">
-                    <img
-                      src={originalImage.src}
-                      alt="Original"
-                      className="max-w-full h-auto"
-                    />
+                    <div className="relative inline-block max-w-full align-top">
+                      {view === "image" ? (
+                        <img
+                          src={originalImage.src}
+                          alt="Original"
+                          className="block max-w-full h-auto"
+                        />
+                      ) : (
+                        // The preview is small; stretch it to the image size
+                        <canvas
+                          ref={heatmapCanvasRef}
+                          style={{ width: originalImage.width }}
+                          className="block max-w-full h-auto"
+                        />
+                      )}
+                      <canvas
+                        ref={overlayCanvasRef}
+                        className="absolute inset-0 w-full h-full pointer-events-none"
+                      />
+                    </div>
                   </div>
                   <div className="mt-2 text-sm text-gray-600">
                     Dimensions: {originalImage.width} × {originalImage.height}
@@ -424,9 +475,8 @@ function App() {
                     Processed Image
                   </h3>
                   <div className="border border-gray-300 rounded-md overflow-hidden">
-                    <img
-                      src={processedImage.src}
-                      alt="Processed"
+                    <canvas
+                      ref={processedCanvasRef}
                       className="max-w-full h-auto"
                     />
                   </div>
@@ -5,81 +5,113 @@
  * that contains the seam carving algorithm implementation.
  *
  * Key responsibilities:
- * - Loading the WebAssembly module from the server
- * - Initializing the module with required memory
- * - Providing a clean interface for the main application
+ * - Starting the carving worker that hosts the WebAssembly module
+ * - Providing a promise-based interface to the worker for the main application
  * - Managing module lifecycle and error handling
  *
  * The module exports:
- * - loadWasm(): Promise<void> - Loads and initializes the WASM module
- * - getWasmModule(): Object - Returns the initialized WASM module instance
+ * - loadWasm(): Promise<Object> - Starts the worker and loads the WASM module
+ * - getWasmModule(): Object - Returns the interface to the loaded module:
+ *   - decodeImage(file): Promise<{ width, height }>
+ *   - carveImage(seamCount, options, onSeams): Promise<{ bitmap, width, height }>
+ *     onSeams, if given, receives batches of removed seams while carving
+ *   - encodeImage(type): Promise<Blob> - Encodes the last carved image
+ *   - heatmapImage(kind, maxSize): Promise<{ bitmap, width, height }> -
+ *     Energy ("energy") or cumulative cost ("cost") preview of the image
+ *   - releaseImage(): Promise
+ *
+ * Image files are decoded inside the worker (createImageBitmap), so large
+ * photos are never inflated into data URLs or drawn on the main thread.
+ * Results come back as ImageBitmaps for display and are only encoded, inside
+ * the worker, when they are downloaded.
  *
  * Dependencies:
- * - WebAssembly API
+ * - workers/carveWorker.js
  * - seamcarving.wasm (compiled from C)
  */
 
-// This module will handle loading the WebAssembly module
-
-// Placeholder for the actual WebAssembly module
+let worker = null;
 let wasmModule = null;
+let nextRequestId = 0;
+const pendingRequests = new Map();
+
+// Send a message to the worker and resolve with its reply; progress messages
+// sent before the reply go to onProgress
+const request = (type, payload = {}, transfer = [], onProgress = null) =>
+  new Promise((resolve, reject) => {
+    const id = nextRequestId++;
+    pendingRequests.set(id, { resolve, reject, onProgress });
+    worker.postMessage({ id, type, ...payload }, transfer);
+  });
+
+const handleMessage = ({ data: { id, result, error, progress } }) => {
+  const pending = pendingRequests.get(id);
+  if (!pending) return;
+
+  if (progress) {
+    if (pending.onProgress) pending.onProgress(progress);
+    return;
+  }
+
+  pendingRequests.delete(id);
+  if (error) {
+    pending.reject(new Error(error));
+  } else {
+    pending.resolve(result);
+  }
+};
+
+// The worker failed to load or threw outside a request: fail everything
+// waiting on it and drop it, so the next loadWasm starts a fresh one
+const handleWorkerError = (event) => {
+  const error = new Error(
+    `Carving worker failed: ${event.message || "could not be loaded"}`
+  );
+  for (const pending of pendingRequests.values()) {
+    pending.reject(error);
+  }
+  pendingRequests.clear();
+  worker.terminate();
+  worker = null;
+  wasmModule = null;
+};
 
 /**
- * Loads the WebAssembly module for seam carving
- * In the future, this will load the actual WASM module
+ * Loads the WebAssembly module for seam carving inside the carving worker
  */
 export const loadWasm = async () => {
-  return new Promise((resolve, reject) => {
-    try {
-      console.log(
-        "Attempting to load WebAssembly module from /wasm/seamcarving.wasm"
-      );
-
-      // In a real implementation, we would do something like:
-      // const importObject = {
-      //   env: {
-      //     memory: new WebAssembly.Memory({ initial: 256, maximum: 512 }),
-      //     abort: () => console.log('Abort!')
-      //   }
-      // };
+  if (!worker) {
+    worker = new Worker(
+      new URL("./workers/carveWorker.js", import.meta.url),
+      { type: "module" }
+    );
+    worker.onmessage = handleMessage;
+    worker.onerror = handleWorkerError;
+  }
 
-      // const response = await fetch('/wasm/seamcarving.wasm');
-      // const bytes = await response.arrayBuffer();
-      // const results = await WebAssembly.instantiate(bytes, importObject);
-      // wasmModule = results.instance.exports;
+  try {
+    console.log("Attempting to load WebAssembly module in the carving worker");
+    await request("init");
+  } catch (error) {
+    console.error("Failed to load WebAssembly module:", error);
+    throw error;
+  }
 
-      // For now, just simulate successful loading with some mock functions
-      setTimeout(() => {
-        wasmModule = {
-          // Mock functions that would be implemented in the C code
-          seamCarve: (imageData, width, height, seamCount) => {
-            console.log("Mock seam carving called with parameters:", {
-              width,
-              height,
-              seamCount,
-            });
-            return new ImageData(width - seamCount, height);
-          },
-          calculateEnergy: (imageData, width, height) => {
-            console.log("Mock energy calculation called");
-            return new Float32Array(width * height);
-          },
-          findSeam: (energy, width, height) => {
-            console.log("Mock seam finding called");
-            return new Uint32Array(height);
-          },
-          removeSeam: (imageData, width, height, seam) => {
-            console.log("Mock seam removal called");
-            return new ImageData(width - 1, height);
-          },
-        };
-        resolve(wasmModule);
-      }, 800);
-    } catch (error) {
-      console.error("Failed to load WebAssembly module:", error);
-      reject(error);
-    }
-  });
+  wasmModule = {
+    decodeImage: (file) => request("decode", { file }),
+    carveImage: (seamCount, options = {}, onSeams = null) =>
+      request(
+        "carve",
+        { seamCount, options: { ...options, streamSeams: !!onSeams } },
+        [],
+        onSeams
+      ),
+    encodeImage: (type = "image/png") => request("encode", { type }),
+    heatmapImage: (kind, maxSize = 512) =>
+      request("heatmap", { kind, maxSize }),
+    releaseImage: () => request("release"),
+  };
+  return wasmModule;
 };
 
 /**
@@ -91,29 +123,3 @@ export const getWasmModule = () => {
   }
   return wasmModule;
 };
-
-/**
- * Helper function to convert an HTML image to ImageData
- */
-export const imageToImageData = (img) => {
-  const canvas = document.createElement("canvas");
-  canvas.width = img.width;
-  canvas.height = img.height;
-  const ctx = canvas.getContext("2d");
-  ctx.drawImage(img, 0, 0);
-  return ctx.getImageData(0, 0, canvas.width, canvas.height);
-};
-
-/**
- * Helper function to convert ImageData back to a data URL
- */
-export const imageDataToDataURL = (imageData) => {
-  const canvas = document.createElement("canvas");
-  canvas.width = imageData.width;
-  canvas.height = imageData.height;
-  const ctx = canvas.getContext("2d");
-  ctx.putImageData(imageData, 0, 0);
-  return canvas.toDataURL();
-};
-
-// Add more WebAssembly-related utility functions as needed
@@ -8,6 +8,7 @@
  * Key functions:
  * - calculateSeamsToRemove: Determines the number of seams to remove
  * - validateSeamReduction: Ensures the reduction is within safe limits
+ * - drawSeams: Draws a batch of removed seams onto an overlay canvas
  *
  * The module works in conjunction with the WebAssembly implementation
  * to ensure safe and efficient seam carving operations.
@@ -136,3 +137,24 @@ export const validateSeamReduction = (
 
   return { valid: true };
 };
+
+/**
+ * Draws removed seams, as streamed by the carving worker, onto a 2D context
+ * in original-image coordinates
+ *
+ * @param {CanvasRenderingContext2D} ctx - Overlay context, sized like the original image
+ * @param {Int32Array} starts - Column of each seam in the first row
+ * @param {Int16Array} steps - Column change from row to row, height - 1 per seam
+ * @param {number} height - Image height in pixels
+ */
+export const drawSeams = (ctx, starts, steps, height) => {
+  ctx.fillStyle = "rgba(255, 0, 0, 0.6)";
+  for (let k = 0; k < starts.length; k++) {
+    let x = starts[k];
+    ctx.fillRect(x, 0, 1, 1);
+    for (let j = 1; j < height; j++) {
+      x += steps[k * (height - 1) + j - 1];
+      ctx.fillRect(x, j, 1, 1);
+    }
+  }
+};
@@ -8,9 +8,13 @@
  * - Error handling and validation
  *
  * Key functions:
- * - imageToWasm: Converts JavaScript ImageData to WebAssembly memory
- * - wasmToImage: Converts WebAssembly memory back to JavaScript ImageData
- * - processImage: Main function for seam carving operations
+ * - decodeToHeap: Decodes an image file directly into WebAssembly memory
+ * - releaseWorkspace: Frees the carving buffers kept between images
+ * - carveHeapImage: Carves an image already in WebAssembly memory
+ * - carveHeapImageWithSeams: Same, reporting each removed seam as it goes
+ * - heatmapHeapImage: Renders a small energy or cumulative cost preview
+ * - processImage: Main function for seam carving operations (exact or banded)
+ * - processImageBatch: Carves many same-sized thumbnails in one call
  *
  * The module serves as a bridge between the JavaScript frontend
  * and the C-based WebAssembly implementation.
@@ -24,131 +28,389 @@
 
 // Initialize the WASM module
 let wasmModule = null;
+let wasmModulePromise = null;
 
-// Function to load the WASM module
-export const initWasmModule = () => {
-  return new Promise((resolve, reject) => {
-    // Check if the module is already loaded
-    if (wasmModule) {
-      resolve(wasmModule);
-      return;
-    }
+// Create function wrappers for the exported C functions
+const wrapExports = (module) => {
+  module.seam_carve = module.cwrap("seam_carve", "number", [
+    "number",
+    "number",
+    "number",
+  ]);
+  module.carve_seams = module.cwrap("carve_seams", "number", [
+    "number",
+    "number",
+    "number",
+    "number",
+    "number",
+    "number",
+  ]);
+  module.carve_seams_logged = module.cwrap("carve_seams_logged", "number", [
+    "number",
+    "number",
+    "number",
+    "number",
+    "number",
+    "number",
+    "number",
+    "number",
+    "number",
+  ]);
+  module.carve_seams_strips = module.cwrap("carve_seams_strips", "number", [
+    "number",
+    "number",
+    "number",
+    "number",
+    "number",
+    "number",
+    "number",
+  ]);
+  module.carve_seams_lanes = module.cwrap("carve_seams_lanes", "number", [
+    "number",
+    "number",
+    "number",
+    "number",
+    "number",
+    "number",
+  ]);
+  module.sc_reserve = module.cwrap("sc_reserve", "number", [
+    "number",
+    "number",
+  ]);
+  module.sc_reset = module.cwrap("sc_reset", null, []);
+  module.heatmap = module.cwrap("heatmap", "number", [
+    "number",
+    "number",
+    "number",
+    "number",
+    "number",
+    "number",
+    "number",
+  ]);
+  module.create_image = module.cwrap("create_image", "number", [
+    "number",
+    "number",
+  ]);
+  module.free_image = module.cwrap("free_image", null, ["number"]);
+  module.calc_energy = module.cwrap("calc_energy", null, [
+    "number",
+    "number",
+    "number",
+    "number",
+  ]);
+  module.get_width = module.cwrap("get_width", "number", ["number", "number"]);
+  module.get_height = module.cwrap("get_height", "number", [
+    "number",
+    "number",
+  ]);
+  return module;
+};
 
-    // The Module object is created by the emscripten-generated seamcarving.js
-    const moduleLoadPromise = new Promise((moduleResolve) => {
-      window.Module = {
-        onRuntimeInitialized: () => {
-          moduleResolve(window.Module);
-        },
-        print: (text) => console.log(text),
-        printErr: (text) => console.error(text),
-      };
-    });
-
-    // Dynamically load the seamcarving.js script
-    const script = document.createElement("script");
-    script.src = "/seamcarving.js";
-    script.async = true;
-    script.onload = () => {
-      moduleLoadPromise.then((module) => {
-        wasmModule = module;
-        // Create function wrappers
-        wasmModule.seam_carve = module.cwrap("seam_carve", "number", [
-          "number",
-          "number",
-          "number",
-        ]);
-        wasmModule.create_image = module.cwrap("create_image", "number", [
-          "number",
-          "number",
-        ]);
-        wasmModule.free_image = module.cwrap("free_image", null, ["number"]);
-        wasmModule.calc_energy = module.cwrap("calc_energy", null, [
-          "number",
-          "number",
-          "number",
-          "number",
-        ]);
-        wasmModule.get_width = module.cwrap("get_width", "number", [
-          "number",
-          "number",
-        ]);
-        wasmModule.get_height = module.cwrap("get_height", "number", [
-          "number",
-          "number",
-        ]);
-
-        resolve(wasmModule);
+// Function to load the WASM module. seamcarving.js is built as an ES module
+// factory, so this works both on the main thread and inside a worker.
+export const initWasmModule = () => {
+  // Check if the module is already loaded (or loading)
+  if (!wasmModulePromise) {
+    wasmModulePromise = import(/* @vite-ignore */ "/seamcarving.js")
+      .then(({ default: createModule }) =>
+        createModule({
+          print: (text) => console.log(text),
+          printErr: (text) => console.error(text),
+        })
+      )
+      .then((module) => {
+        wasmModule = wrapExports(module);
+        return wasmModule;
+      })
+      .catch(() => {
+        wasmModulePromise = null;
+        throw new Error("Failed to load WebAssembly module");
       });
-    };
-    script.onerror = () => {
-      reject(new Error("Failed to load WebAssembly module"));
-    };
+  }
+  return wasmModulePromise;
+};
 
-    document.body.appendChild(script);
-  });
+// Function to decode an image file straight into WASM memory. The file is
+// decoded with createImageBitmap and read back through an OffscreenCanvas, so
+// no data URL or <img> element is involved and it can run inside a worker.
+// The engine's working set is reserved from the image size first, so memory
+// grows at most once here rather than in the middle of a carve.
+// Returns { ptr, width, height }; release it with freeHeapImage.
+export const decodeToHeap = async (blob) => {
+  const module = await initWasmModule();
+
+  const bitmap = await createImageBitmap(blob);
+  const { width, height } = bitmap;
+  const canvas = new OffscreenCanvas(width, height);
+  const ctx = canvas.getContext("2d", { willReadFrequently: true });
+  ctx.drawImage(bitmap, 0, 0);
+  bitmap.close();
+
+  const { data } = ctx.getImageData(0, 0, width, height);
+  const ptr =
+    module.sc_reserve(height, width) === 0
+      ? module._malloc(width * height * 4)
+      : 0;
+  if (!ptr) {
+    throw new Error("Not enough memory for this image");
+  }
+  module.HEAPU8.set(data, ptr);
+
+  return { ptr, width, height };
 };
 
-// Function to process an image with the seam carving algorithm
-export const processImage = async (imageData) => {
-  try {
-    const module = await initWasmModule();
+export const freeHeapImage = (image) => {
+  if (wasmModule && image) {
+    wasmModule._free(image.ptr);
+  }
+};
 
-    const { width, height, data } = imageData;
+// Function to free the buffers the engine keeps for carving the next image
+export const releaseWorkspace = () => {
+  if (wasmModule) {
+    wasmModule.sc_reset();
+  }
+};
+
+// Function to carve an image that already lives in WASM memory (see
+// decodeToHeap). The input is left untouched; options are as for processImage.
+export const carveHeapImage = async (image, seamCount = 1, options = {}) => {
+  const { bandMargin = 0, refreshInterval = 0, strips = 1 } = options;
+  const module = await initWasmModule();
+  const { ptr, width, height } = image;
+
+  // Call the seam carving function
+  const outputPtr =
+    strips > 1
+      ? module.carve_seams_strips(
+          ptr,
+          height,
+          width,
+          seamCount,
+          strips,
+          bandMargin,
+          refreshInterval
+        )
+      : module.carve_seams(
+          ptr,
+          height,
+          width,
+          seamCount,
+          bandMargin,
+          refreshInterval
+        );
+  if (!outputPtr) {
+    throw new Error(
+      `Cannot remove ${seamCount} seams from a ${width}px wide image`
+    );
+  }
+
+  // Create a new ImageData object with the result
+  const newWidth = width - seamCount;
+  const resultData = new Uint8ClampedArray(
+    module.HEAPU8.buffer.slice(outputPtr, outputPtr + newWidth * height * 4)
+  );
+  module._free(outputPtr);
 
-    // Allocate memory for the input image
-    const inputPtr = module._malloc(width * height * 4);
+  return new ImageData(resultData, newWidth, height);
+};
+
+// Function to carve an image in WASM memory in batches of seamBatch seams,
+// calling onSeams({ starts, steps }) after every batch with the removed seams
+// in original-image coordinates: seam k starts at column starts[k] in row 0
+// and moves by steps[k * (height - 1) + j - 1] from row j - 1 to row j. That is
+// a few bytes per row instead of a frame per seam. Strip mode does not apply.
+export const carveHeapImageWithSeams = async (
+  image,
+  seamCount,
+  options = {},
+  onSeams = () => {}
+) => {
+  const { bandMargin = 0, refreshInterval = 0, seamBatch = 8 } = options;
+  const module = await initWasmModule();
+  const { ptr, width, height } = image;
 
-    // Copy image data to the WASM memory
-    const heapBytes = new Uint8Array(
-      module.HEAPU8.buffer,
-      inputPtr,
-      width * height * 4
+  if (seamCount < 0 || seamCount >= width) {
+    throw new Error(
+      `Cannot remove ${seamCount} seams from a ${width}px wide image`
     );
-    heapBytes.set(data);
+  }
+
+  const pixels = width * height;
+  const workPtr = module._malloc(pixels * 4);
+  const indexPtr = module._malloc(pixels * 4);
+  const startsPtr = module._malloc(seamBatch * 4);
+  const stepsPtr = module._malloc(seamBatch * Math.max(height - 1, 1) * 2);
 
-    // Call the seam carving function
-    const outputPtr = module.seam_carve(inputPtr, height, width);
+  try {
+    module.HEAPU8.copyWithin(workPtr, ptr, ptr + pixels * 4);
+    const index = new Int32Array(module.HEAPU8.buffer, indexPtr, pixels);
+    for (let j = 0; j < height; j++) {
+      for (let i = 0; i < width; i++) {
+        index[j * width + i] = i;
+      }
+    }
+
+    let currentWidth = width;
+    for (let done = 0; done < seamCount; ) {
+      const batch = Math.min(seamBatch, seamCount - done);
+      currentWidth = module.carve_seams_logged(
+        workPtr,
+        indexPtr,
+        height,
+        currentWidth,
+        batch,
+        bandMargin,
+        refreshInterval,
+        startsPtr,
+        stepsPtr
+      );
+      done += batch;
+
+      // Copy the log out; the engine reuses these buffers for the next batch
+      const { buffer } = module.HEAPU8;
+      onSeams({
+        starts: new Int32Array(buffer.slice(startsPtr, startsPtr + batch * 4)),
+        steps: new Int16Array(
+          buffer.slice(stepsPtr, stepsPtr + batch * (height - 1) * 2)
+        ),
+      });
+    }
 
-    // Create a new ImageData object with the result
-    const newWidth = width - 1;
     const resultData = new Uint8ClampedArray(
-      module.HEAPU8.buffer.slice(outputPtr, outputPtr + newWidth * height * 4)
+      module.HEAPU8.buffer.slice(workPtr, workPtr + currentWidth * height * 4)
     );
+    return new ImageData(resultData, currentWidth, height);
+  } finally {
+    module._free(workPtr);
+    module._free(indexPtr);
+    module._free(startsPtr);
+    module._free(stepsPtr);
+  }
+};
 
-    // Clean up memory
-    module._free(inputPtr);
-    module._free(outputPtr);
+// Heatmap kinds, as in seamcarving_wasm.h
+export const HEATMAP_ENERGY = 0;
+export const HEATMAP_COST = 1;
 
-    return new ImageData(resultData, newWidth, height);
+// Function to render a heatmap of an image in WASM memory, at most maxSize
+// pixels on a side. The engine computes it at that size in one pass, so only
+// the preview, never a full-size RGBA copy, comes back. Returns ImageData.
+export const heatmapHeapImage = async (image, kind, maxSize = 512) => {
+  const module = await initWasmModule();
+  const { ptr, width, height } = image;
+
+  const scale = Math.min(1, maxSize / Math.max(width, height));
+  const outWidth = Math.max(1, Math.floor(width * scale));
+  const outHeight = Math.max(1, Math.floor(height * scale));
+
+  const outPtr = module._malloc(outWidth * outHeight);
+  try {
+    if (
+      module.heatmap(ptr, height, width, kind, outPtr, outHeight, outWidth) !==
+      0
+    ) {
+      throw new Error("Invalid heatmap request");
+    }
+
+    // Expand the gray levels to RGBA for display
+    const gray = module.HEAPU8.subarray(outPtr, outPtr + outWidth * outHeight);
+    const rgba = new Uint8ClampedArray(outWidth * outHeight * 4);
+    for (let k = 0; k < gray.length; k++) {
+      rgba[4 * k] = rgba[4 * k + 1] = rgba[4 * k + 2] = gray[k];
+      rgba[4 * k + 3] = 255;
+    }
+    return new ImageData(rgba, outWidth, outHeight);
+  } finally {
+    module._free(outPtr);
+  }
+};
+
+// Function to process an image with the seam carving algorithm
+//
+// Options:
+// - bandMargin: 0 for exact seams, otherwise each seam is searched only within
+//   this many columns of the previous one ("fast" mode)
+// - refreshInterval: in fast mode, run a full search every N seams to correct
+//   drift (0 leaves only the cost-triggered refresh)
+// - strips: split the image into this many vertical strips carved
+//   independently (in parallel in threaded builds); 1 keeps seams global
+export const processImage = async (imageData, seamCount = 1, options = {}) => {
+  try {
+    const module = await initWasmModule();
+
+    const { width, height, data } = imageData;
+
+    // Allocate memory for the input image and copy the image data into it
+    const ptr = module._malloc(width * height * 4);
+    module.HEAPU8.set(data, ptr);
+
+    try {
+      return await carveHeapImage({ ptr, width, height }, seamCount, options);
+    } finally {
+      // Clean up memory
+      module._free(ptr);
+    }
   } catch (error) {
     console.error("Error processing image:", error);
     throw error;
   }
 };
 
-// Helper function to convert an HTML Image to ImageData
-export const getImageDataFromImage = (img) => {
-  const canvas = document.createElement("canvas");
-  const ctx = canvas.getContext("2d");
+// Function to carve many small images of the same size (e.g. thumbnails) in a
+// single call. The engine carves them in lockstep with one image per SIMD
+// lane, which is much faster than calling processImage for each one.
+export const processImageBatch = async (imageDatas, seamCount = 1) => {
+  const module = await initWasmModule();
+  const { width, height } = imageDatas[0];
+  const count = imageDatas.length;
+  const imageBytes = width * height * 4;
 
-  canvas.width = img.width;
-  canvas.height = img.height;
+  if (imageDatas.some((img) => img.width !== width || img.height !== height)) {
+    throw new Error("All images in a batch must have the same dimensions");
+  }
 
-  ctx.drawImage(img, 0, 0);
+  // Arrays of input and output image pointers
+  const srcPtrs = module._malloc(count * 4);
+  const destPtrs = module._malloc(count * 4);
+  const inputPtrs = imageDatas.map((img) => {
+    const ptr = module._malloc(imageBytes);
+    module.HEAPU8.set(img.data, ptr);
+    return ptr;
+  });
+  new Uint32Array(module.HEAPU8.buffer, srcPtrs, count).set(inputPtrs);
 
-  return ctx.getImageData(0, 0, img.width, img.height);
-};
+  const status = module.carve_seams_lanes(
+    srcPtrs,
+    destPtrs,
+    count,
+    height,
+    width,
+    seamCount
+  );
 
-// Helper function to convert ImageData to a data URL
-export const getDataURLFromImageData = (imageData) => {
-  const canvas = document.createElement("canvas");
-  const ctx = canvas.getContext("2d");
+  inputPtrs.forEach((ptr) => module._free(ptr));
+  module._free(srcPtrs);
 
-  canvas.width = imageData.width;
-  canvas.height = imageData.height;
+  if (status !== 0) {
+    module._free(destPtrs);
+    throw new Error(
+      `Cannot remove ${seamCount} seams from a ${width}px wide image`
+    );
+  }
 
-  ctx.putImageData(imageData, 0, 0);
+  // The heap may have grown during the call, so take fresh views
+  const newWidth = width - seamCount;
+  const outputPtrs = Array.from(
+    new Uint32Array(module.HEAPU8.buffer, destPtrs, count)
+  );
+  module._free(destPtrs);
 
-  return canvas.toDataURL("image/png");
+  return outputPtrs.map((ptr) => {
+    const resultData = new Uint8ClampedArray(
+      module.HEAPU8.buffer.slice(ptr, ptr + newWidth * height * 4)
+    );
+    module._free(ptr);
+    return new ImageData(resultData, newWidth, height);
+  });
 };
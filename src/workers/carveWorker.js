@@ -0,0 +1,123 @@
+/**
+ * Carving Worker
+ *
+ * Runs the WebAssembly seam carving engine off the main thread. The worker
+ * keeps the decoded image in WebAssembly memory between requests, so the
+ * pixels never travel through the main thread on their way in.
+ *
+ * Messages are { id, type, ...payload } and are answered with
+ * { id, result } or { id, error }:
+ * - init: Loads the WebAssembly module
+ * - decode { file }: Decodes a File/Blob into WebAssembly memory, replacing
+ *   the previous image; resolves to { width, height }
+ * - carve { seamCount, options }: Carves the decoded image; resolves to
+ *   { bitmap, width, height } with the ImageBitmap transferred. With
+ *   options.streamSeams the removed seams are posted as progress messages
+ *   { id, progress: { starts, steps } } while carving (see
+ *   carveHeapImageWithSeams) and only the final image is transferred
+ * - encode { type }: Encodes the last carved image; resolves to a Blob
+ * - heatmap { kind, maxSize }: Renders an energy ("energy") or cumulative cost
+ *   ("cost") preview of the decoded image; resolves to { bitmap, width, height }
+ * - release: Frees the decoded and carved images and the carving buffers the
+ *   engine keeps between images
+ *
+ * Dependencies:
+ * - wasmUtils.js
+ * - createImageBitmap and OffscreenCanvas (convertToBlob)
+ */
+
+import {
+  initWasmModule,
+  decodeToHeap,
+  carveHeapImage,
+  carveHeapImageWithSeams,
+  heatmapHeapImage,
+  HEATMAP_ENERGY,
+  HEATMAP_COST,
+  freeHeapImage,
+  releaseWorkspace,
+} from "../utils/wasmUtils";
+
+// The decoded source image, as returned by decodeToHeap
+let currentImage = null;
+// The last carved image, kept so it can be encoded on demand
+let carvedImage = null;
+
+const releaseImage = () => {
+  freeHeapImage(currentImage);
+  currentImage = null;
+  carvedImage = null;
+};
+
+const handlers = {
+  init: async () => {
+    await initWasmModule();
+    return { result: true };
+  },
+
+  decode: async ({ file }) => {
+    releaseImage();
+    currentImage = await decodeToHeap(file);
+    const { width, height } = currentImage;
+    return { result: { width, height } };
+  },
+
+  carve: async ({ seamCount, options = {} }, id) => {
+    if (!currentImage) {
+      throw new Error("No image has been decoded");
+    }
+    carvedImage = options.streamSeams
+      ? await carveHeapImageWithSeams(
+          currentImage,
+          seamCount,
+          options,
+          (progress) =>
+            self.postMessage({ id, progress }, [
+              progress.starts.buffer,
+              progress.steps.buffer,
+            ])
+        )
+      : await carveHeapImage(currentImage, seamCount, options);
+    const bitmap = await createImageBitmap(carvedImage);
+    const { width, height } = carvedImage;
+    return { result: { bitmap, width, height }, transfer: [bitmap] };
+  },
+
+  encode: async ({ type = "image/png" }) => {
+    if (!carvedImage) {
+      throw new Error("No image has been carved");
+    }
+    const canvas = new OffscreenCanvas(carvedImage.width, carvedImage.height);
+    canvas.getContext("2d").putImageData(carvedImage, 0, 0);
+    return { result: await canvas.convertToBlob({ type }) };
+  },
+
+  heatmap: async ({ kind, maxSize }) => {
+    if (!currentImage) {
+      throw new Error("No image has been decoded");
+    }
+    const preview = await heatmapHeapImage(
+      currentImage,
+      kind === "cost" ? HEATMAP_COST : HEATMAP_ENERGY,
+      maxSize
+    );
+    const bitmap = await createImageBitmap(preview);
+    const { width, height } = preview;
+    return { result: { bitmap, width, height }, transfer: [bitmap] };
+  },
+
+  release: async () => {
+    releaseImage();
+    releaseWorkspace();
+    return { result: true };
+  },
+};
+
+self.onmessage = async ({ data: { id, type, ...payload } }) => {
+  try {
+    const { result, transfer = [] } = await handlers[type](payload, id);
+    self.postMessage({ id, result }, transfer);
+  } catch (error) {
+    self.postMessage({ id, error: error.message });
+  }
+};
@@ -0,0 +1,15 @@
+#!/bin/bash
+# Builds the native command-line tool (wasm/build/seamcarving) from the same
+# C sources as the WebAssembly module.
+
+CC=${CC:-cc}
+mkdir -p build
+
+$CC seamcarving_wasm.c ppm.c sc_queue.c sc_daemon.c sc_checkpoint.c \
+    sc_tune.c seamcarving_cli.c \
+    -o build/seamcarving \
+    -DSC_THREADS -pthread \
+    -O3 -march=native -lm || exit 1
+
+echo "Native tool built successfully!"
+echo "  - build/seamcarving"
@@ -0,0 +1,24 @@
+#!/bin/bash
+# Builds the Node.js addon (wasm/build/seamcarving.node) from the same C
+# sources as the WebAssembly module, with native SIMD and strip threads.
+# Load it through seamcarving_node.js.
+
+CC=${CC:-cc}
+NODE_INCLUDE=${NODE_INCLUDE:-$(node -p "require('path').resolve(process.execPath, '../../include/node')")}
+mkdir -p build
+
+# Node resolves the N-API symbols when it loads the addon
+LINK_FLAGS=""
+if [ "$(uname)" == "Darwin" ]; then
+    LINK_FLAGS="-undefined dynamic_lookup"
+fi
+
+$CC seamcarving_wasm.c seamcarving_node.c \
+    -o build/seamcarving.node \
+    -shared -fPIC $LINK_FLAGS \
+    -I"$NODE_INCLUDE" -DNODE_GYP_MODULE_NAME=seamcarving \
+    -DSC_THREADS -pthread \
+    -O3 -march=native -lm || exit 1
+
+echo "Node.js addon built successfully!"
+echo "  - build/seamcarving.node"
@@ -0,0 +1,25 @@
+#!/bin/bash
+# Builds the CPython extension (wasm/build/seamcarving*.so) from the same C
+# sources as the WebAssembly module. Put wasm/build on PYTHONPATH and
+# `import seamcarving`.
+
+CC=${CC:-cc}
+PYTHON=${PYTHON:-python3}
+PY_INCLUDES=$($PYTHON -c "import sysconfig; print('-I' + sysconfig.get_paths()['include'])")
+PY_SUFFIX=$($PYTHON -c "import sysconfig; print(sysconfig.get_config_var('EXT_SUFFIX'))")
+mkdir -p build
+
+# Python resolves its own symbols when it loads the extension
+LINK_FLAGS=""
+if [ "$(uname)" == "Darwin" ]; then
+    LINK_FLAGS="-undefined dynamic_lookup"
+fi
+
+$CC seamcarving_wasm.c seamcarving_py.c \
+    -o build/seamcarving$PY_SUFFIX \
+    -shared -fPIC $LINK_FLAGS $PY_INCLUDES \
+    -DSC_THREADS -pthread \
+    -O3 -march=native -lm || exit 1
+
+echo "Python extension built successfully!"
+echo "  - build/seamcarving$PY_SUFFIX"
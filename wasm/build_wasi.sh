@@ -0,0 +1,26 @@
+#!/bin/bash
+# Builds the core library (seamcarving.c, c_img.c) as a WASI module
+# (wasm/build/seamcarving_wasi.wasm) for sandboxed server-side carving.
+# Run it with run_wasi.mjs, or any WASI runtime that preopens the job
+# list's directory.
+
+# clang with a wasm32-wasi sysroot, e.g. from wasi-sdk
+WASI_SDK_PATH=${WASI_SDK_PATH:-/opt/wasi-sdk}
+CC=${CC:-$WASI_SDK_PATH/bin/clang}
+WASI_SYSROOT=${WASI_SYSROOT:-$WASI_SDK_PATH/share/wasi-sysroot}
+
+if ! command -v "$CC" &> /dev/null; then
+    echo "clang with a WASI sysroot was not found"
+    echo "Install wasi-sdk (https://github.com/WebAssembly/wasi-sdk) and set WASI_SDK_PATH"
+    exit 1
+fi
+
+mkdir -p build
+
+$CC --target=wasm32-wasi --sysroot="$WASI_SYSROOT" \
+    seamcarving_wasi.c seamcarving.c c_img.c \
+    -o build/seamcarving_wasi.wasm \
+    -O3 -lm || exit 1
+
+echo "WASI module built successfully!"
+echo "  - build/seamcarving_wasi.wasm"
@@ -11,14 +11,31 @@ if ! command -v emcc &> /dev/null; then
     exit 1
 fi
 
+# Pass --threads to carve strips on worker threads (needs a cross-origin
+# isolated page for SharedArrayBuffer)
+THREAD_FLAGS=""
+if [ "$1" == "--threads" ]; then
+    THREAD_FLAGS="-pthread -DSC_THREADS -s PTHREAD_POOL_SIZE=navigator.hardwareConcurrency"
+fi
+
+# Start with enough memory for a typical photo so the heap rarely grows;
+# override with e.g. INITIAL_MEMORY=256MB ./build_wasm.sh
+INITIAL_MEMORY=${INITIAL_MEMORY:-64MB}
+
 # Compile the WASM module
-emcc seamcarving_wasm.c \
+emcc seamcarving_wasm.c $THREAD_FLAGS \
     -o ../public/seamcarving.js \
     -s WASM=1 \
-    -s EXPORTED_RUNTIME_METHODS='["cwrap", "setValue", "getValue"]' \
-    -s EXPORTED_FUNCTIONS='["_malloc", "_free", "_seam_carve", "_create_image", "_free_image", "_calc_energy", "_get_width", "_get_height"]' \
+    -s EXPORTED_RUNTIME_METHODS='["cwrap", "setValue", "getValue", "HEAPU8"]' \
+    -s EXPORTED_FUNCTIONS='["_malloc", "_free", "_seam_carve", "_carve_seams", "_carve_seams_logged", "_carve_seams_strips", "_carve_seams_budget", "_carve_seams_lanes", "_video_create", "_video_carve_frame", "_video_destroy", "_create_image", "_free_image", "_calc_energy", "_heatmap", "_get_width", "_get_height", "_sc_reserve", "_sc_reset", "_sc_workspace_bytes", "_sc_estimate_bytes", "_sc_set_memory_limit"]' \
     -s ALLOW_MEMORY_GROWTH=1 \
-    -s ENVIRONMENT='web' \
+    -s INITIAL_MEMORY=$INITIAL_MEMORY \
+    -s MAXIMUM_MEMORY=4GB \
+    -msimd128 \
+    -s ENVIRONMENT='web,worker' \
+    -s MODULARIZE=1 \
+    -s EXPORT_ES6=1 \
+    -s EXPORT_NAME=createSeamCarvingModule \
     -O3
 
 echo "WebAssembly module built successfully!"
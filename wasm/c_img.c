@@ -1,19 +1,32 @@
 #include "c_img.h"
 #include <stdio.h>
+#include <string.h>
 #include <math.h>
 
-void create_img(struct rgb_img **im, size_t height, size_t width){
+// Returns 0 on success; on failure returns -1 and sets *im to NULL
+int create_img(struct rgb_img **im, size_t height, size_t width){
     *im = (struct rgb_img *)malloc(sizeof(struct rgb_img));
+    if(*im == NULL){
+        return -1;
+    }
     (*im)->height = height;
     (*im)->width = width;
     (*im)->raster = (uint8_t *)malloc(3 * height * width);
+    if((*im)->raster == NULL){
+        free(*im);
+        *im = NULL;
+        return -1;
+    }
+    return 0;
 }
 
 
+// Returns -1 at the end of the file
 int read_2bytes(FILE *fp){
     uint8_t bytes[2];
-    fread(bytes, sizeof(uint8_t), 1, fp);
-    fread(bytes+1, sizeof(uint8_t), 1, fp);
+    if(fread(bytes, sizeof(uint8_t), 2, fp) != 2){
+        return -1;
+    }
     return (  ((int)bytes[0]) << 8)  + (int)bytes[1];
 }
 
@@ -25,21 +38,48 @@ void write_2bytes(FILE *fp, int num){
     fwrite(bytes+1, 1, 1, fp);
 }
 
-void read_in_img(struct rgb_img **im, char *filename){
+// Returns 0 on success; on failure returns -1 and sets *im to NULL
+int read_in_img(struct rgb_img **im, char *filename){
+    *im = NULL;
     FILE *fp = fopen(filename, "rb");
-    size_t height = read_2bytes(fp);
-    size_t width = read_2bytes(fp);
-    create_img(im, height, width);
-    fread((*im)->raster, 1, 3*width*height, fp);
+    if(fp == NULL){
+        return -1;
+    }
+    int h = read_2bytes(fp);
+    int w = read_2bytes(fp);
+    if(h <= 0 || w <= 0 || (size_t)h > IMG_MAX_PIXELS / (size_t)w){
+        fclose(fp);
+        return -1;
+    }
+    size_t height = h;
+    size_t width = w;
+    if(create_img(im, height, width) != 0){
+        fclose(fp);
+        return -1;
+    }
+    if(fread((*im)->raster, 1, 3*width*height, fp) != 3*width*height){
+        fclose(fp);
+        destroy_image(*im);
+        *im = NULL;
+        return -1;
+    }
     fclose(fp);
+    return 0;
 }
 
-void write_img(struct rgb_img *im, char *filename){
+// Returns 0 on success, -1 if the file could not be written
+int write_img(struct rgb_img *im, char *filename){
     FILE *fp = fopen(filename, "wb");
+    if(fp == NULL){
+        return -1;
+    }
     write_2bytes(fp, im->height);
     write_2bytes(fp, im->width);
-    fwrite(im->raster, 1, im->height * im->width * 3, fp);
-    fclose(fp);
+    size_t written = fwrite(im->raster, 1, im->height * im->width * 3, fp);
+    if(fclose(fp) != 0 || written != im->height * im->width * 3){
+        return -1;
+    }
+    return 0;
 }
 
 uint8_t get_pixel(struct rgb_img *im, int y, int x, int col){
@@ -58,6 +98,101 @@ void destroy_image(struct rgb_img *im)
     free(im);
 }
 
+// Copies im into a new gap_img, with the gap at the end of every row.
+// Returns 0 on success; on failure returns -1 and sets *gi to NULL
+int create_gap_img(struct gap_img **gi, struct rgb_img *im){
+    *gi = (struct gap_img *)malloc(sizeof(struct gap_img));
+    if(*gi == NULL){
+        return -1;
+    }
+    (*gi)->height = im->height;
+    (*gi)->width = im->width;
+    (*gi)->capacity = im->width;
+    (*gi)->raster = (uint8_t *)malloc(3 * im->height * im->width);
+    (*gi)->gap = (size_t *)malloc(im->height * sizeof(size_t));
+    if((*gi)->raster == NULL || (*gi)->gap == NULL){
+        destroy_gap_img(*gi);
+        *gi = NULL;
+        return -1;
+    }
+    memcpy((*gi)->raster, im->raster, 3 * im->height * im->width);
+    for(size_t j = 0; j < im->height; j++){
+        (*gi)->gap[j] = im->width;
+    }
+    return 0;
+}
+
+void gap_row_span(struct gap_img *gi, int y, struct row_span *span){
+    uint8_t *row = gi->raster + 3 * y * gi->capacity;
+    size_t gap = gi->gap[y];
+    size_t gap_len = gi->capacity - gi->width;
+
+    span->first = row;
+    span->first_len = gap;
+    span->second = row + 3 * (gap + gap_len);
+    span->second_len = gi->width - gap;
+}
+
+// Copies row y into dest, which holds 3 * width bytes
+void gap_copy_row(struct gap_img *gi, int y, uint8_t *dest){
+    struct row_span span;
+    gap_row_span(gi, y, &span);
+    memcpy(dest, span.first, 3 * span.first_len);
+    memcpy(dest + 3 * span.first_len, span.second, 3 * span.second_len);
+}
+
+uint8_t gap_get_pixel(struct gap_img *gi, int y, int x, int col){
+    size_t slot = x;
+    if(slot >= gi->gap[y]){
+        slot += gi->capacity - gi->width;
+    }
+    return gi->raster[3 * (y * gi->capacity + slot) + col];
+}
+
+// Helper function to remove pixel x of row y, whose gap is gap_len wide
+static void remove_gap_pixel(struct gap_img *gi, int y, int x, size_t gap_len){
+    uint8_t *row = gi->raster + 3 * y * gi->capacity;
+    size_t gap = gi->gap[y];
+
+    // Move the gap to x: the pixels between swap sides
+    if((size_t)x < gap){
+        memmove(row + 3 * (x + gap_len), row + 3 * x, 3 * (gap - x));
+    }
+    else if((size_t)x > gap){
+        memmove(row + 3 * gap, row + 3 * (gap + gap_len), 3 * (x - gap));
+    }
+    // Pixel x now follows the gap, so widening the gap removes it
+    gi->gap[y] = x;
+}
+
+// Removes pixel path[y] of every row y
+void gap_remove_seam(struct gap_img *gi, int *path){
+    size_t gap_len = gi->capacity - gi->width;
+    for(size_t j = 0; j < gi->height; j++){
+        remove_gap_pixel(gi, j, path[j], gap_len);
+    }
+    gi->width--;
+}
+
+// Packs gi into a new contiguous image and destroys gi. Returns 0 on
+// success; on failure returns -1, sets *im to NULL and still destroys gi
+int finalize_gap_img(struct gap_img *gi, struct rgb_img **im){
+    if(create_img(im, gi->height, gi->width) != 0){
+        destroy_gap_img(gi);
+        return -1;
+    }
+    for(size_t j = 0; j < gi->height; j++){
+        gap_copy_row(gi, j, (*im)->raster + 3 * j * gi->width);
+    }
+    destroy_gap_img(gi);
+    return 0;
+}
+
+void destroy_gap_img(struct gap_img *gi){
+    free(gi->raster);
+    free(gi->gap);
+    free(gi);
+}
 
 void print_grad(struct rgb_img *grad){
     int height = grad->height;
@@ -5,19 +5,52 @@
 #include <stdint.h>
 
 
+// Largest image read_in_img accepts, so the 8-byte-per-pixel cost array of a
+// carve stays well inside a 32-bit address space
+#define IMG_MAX_PIXELS ((size_t)1 << 26)
+
 struct rgb_img{
     uint8_t *raster;
     size_t height;
     size_t width;
 };
 
-void create_img(struct rgb_img **im, size_t height, size_t width);
-void read_in_img(struct rgb_img **im, char *filename);
-void write_img(struct rgb_img *im, char *filename);
+int create_img(struct rgb_img **im, size_t height, size_t width);
+int read_in_img(struct rgb_img **im, char *filename);
+int write_img(struct rgb_img *im, char *filename);
 uint8_t get_pixel(struct rgb_img *im, int y, int x, int col);
 void set_pixel(struct rgb_img *im, int y, int x, int r, int g, int b);
 void destroy_image(struct rgb_img *im);
 void print_grad(struct rgb_img *grad);
 
+// An image whose rows are gap buffers, for removing many seams in a row.
+// Every row has `capacity` pixel slots and one gap of capacity - width
+// slots; removing a pixel moves the gap to it and widens the gap by one, so
+// it costs the distance from the last removal in that row, not the rest of
+// the row. Read rows through gap_row_span.
+struct gap_img{
+    uint8_t *raster;
+    size_t height;
+    size_t width;
+    size_t capacity;
+    size_t *gap;    // first gap slot of each row
+};
+
+// The pixels of one row of a gap_img: `first` then `second`, 3 bytes each
+struct row_span{
+    uint8_t *first;
+    size_t first_len;
+    uint8_t *second;
+    size_t second_len;
+};
+
+int create_gap_img(struct gap_img **gi, struct rgb_img *im);
+void gap_row_span(struct gap_img *gi, int y, struct row_span *span);
+void gap_copy_row(struct gap_img *gi, int y, uint8_t *dest);
+uint8_t gap_get_pixel(struct gap_img *gi, int y, int x, int col);
+void gap_remove_seam(struct gap_img *gi, int *path);
+int finalize_gap_img(struct gap_img *gi, struct rgb_img **im);
+void destroy_gap_img(struct gap_img *gi);
+
 
 #endif 
\ No newline at end of file
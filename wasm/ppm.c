@@ -0,0 +1,144 @@
+#include "ppm.h"
+#include <stdlib.h>
+#include <ctype.h>
+#include <limits.h>
+
+// Read one unsigned header field, skipping whitespace and # comments
+static int read_field(FILE *fp, int *value) {
+    int c = fgetc(fp);
+    while (c != EOF && (isspace(c) || c == '#')) {
+        if (c == '#') {
+            while (c != EOF && c != '\n') {
+                c = fgetc(fp);
+            }
+        }
+        c = fgetc(fp);
+    }
+    if (c == EOF || !isdigit(c)) {
+        return 0;
+    }
+
+    *value = 0;
+    while (c != EOF && isdigit(c)) {
+        if (*value > (INT_MAX - (c - '0')) / 10) {
+            return 0;
+        }
+        *value = *value * 10 + (c - '0');
+        c = fgetc(fp);
+    }
+    // Exactly one whitespace byte separates the header from the pixel data
+    return 1;
+}
+
+// Helper function for ppm_read, refusing images over max_pixels
+static int read_image(FILE *fp, uint8_t **rgba, int *height, int *width, size_t max_pixels) {
+    int c = fgetc(fp);
+    while (c != EOF && isspace(c)) {
+        c = fgetc(fp);
+    }
+    if (c == EOF) {
+        return 0;
+    }
+
+    int maxval;
+    if (c != 'P' || fgetc(fp) != '6' || !read_field(fp, width) ||
+        !read_field(fp, height) || !read_field(fp, &maxval)) {
+        return -1;
+    }
+    if (*width <= 0 || *height <= 0 || maxval != 255) {
+        return -1;
+    }
+    if ((size_t)(*height) > max_pixels / (size_t)(*width)) {
+        return -1;
+    }
+
+    size_t pixels = (size_t)(*height) * (*width);
+    *rgba = (uint8_t *)malloc(pixels * 4);
+    uint8_t *row = (uint8_t *)malloc((size_t)(*width) * 3);
+    if (!*rgba || !row) {
+        free(row);
+        free(*rgba);
+        *rgba = NULL;
+        return -1;
+    }
+
+    for (int j = 0; j < *height; j++) {
+        if (fread(row, 3, *width, fp) != (size_t)(*width)) {
+            free(row);
+            free(*rgba);
+            *rgba = NULL;
+            return -1;
+        }
+        uint8_t *dest = *rgba + (size_t)j * (*width) * 4;
+        for (int i = 0; i < *width; i++) {
+            dest[4 * i + 0] = row[3 * i + 0];
+            dest[4 * i + 1] = row[3 * i + 1];
+            dest[4 * i + 2] = row[3 * i + 2];
+            dest[4 * i + 3] = 255;
+        }
+    }
+
+    free(row);
+    return 1;
+}
+
+// Read the next binary PPM (P6) image of a stream into a new RGBA raster.
+// Returns 1 on success, 0 at the end of the stream and -1 on malformed input.
+int ppm_read(FILE *fp, uint8_t **rgba, int *height, int *width) {
+    return read_image(fp, rgba, height, width, PPM_MAX_PIXELS);
+}
+
+// Write an RGBA raster as a binary PPM (P6), dropping alpha. Returns 0 on success.
+int ppm_write(FILE *fp, uint8_t *rgba, int height, int width) {
+    uint8_t *row = (uint8_t *)malloc(width * 3);
+
+    fprintf(fp, "P6\n%d %d\n255\n", width, height);
+    for (int j = 0; j < height; j++) {
+        uint8_t *src = rgba + (size_t)j * width * 4;
+        for (int i = 0; i < width; i++) {
+            row[3 * i + 0] = src[4 * i + 0];
+            row[3 * i + 1] = src[4 * i + 1];
+            row[3 * i + 2] = src[4 * i + 2];
+        }
+        if (fwrite(row, 3, width, fp) != (size_t)width) {
+            free(row);
+            return -1;
+        }
+    }
+
+    free(row);
+    return 0;
+}
+
+// Write a one-byte-per-pixel image as a binary PGM. Returns 0 on success.
+int pgm_write(FILE *fp, uint8_t *gray, int height, int width) {
+    fprintf(fp, "P5\n%d %d\n255\n", width, height);
+    if (fwrite(gray, width, height, fp) != (size_t)height) {
+        return -1;
+    }
+    return 0;
+}
+
+// Decode a PPM held in memory. Returns 1 on success, otherwise 0 or -1 as ppm_read.
+int ppm_decode(uint8_t *data, size_t size, uint8_t **rgba, int *height, int *width) {
+    FILE *fp = fmemopen(data, size, "rb");
+    if (!fp) {
+        return -1;
+    }
+    // The pixels must be in the buffer, so a header cannot claim more
+    size_t max_pixels = (size / 3 < PPM_MAX_PIXELS) ? size / 3 : PPM_MAX_PIXELS;
+    int status = read_image(fp, rgba, height, width, max_pixels);
+    fclose(fp);
+    return status;
+}
+
+// Encode an RGBA raster as a PPM in a new malloc'd buffer. Returns 0 on success.
+int ppm_encode(uint8_t *rgba, int height, int width, uint8_t **data, size_t *size) {
+    FILE *fp = open_memstream((char **)data, size);
+    if (!fp) {
+        return -1;
+    }
+    int status = ppm_write(fp, rgba, height, width);
+    fclose(fp);
+    return status;
+}
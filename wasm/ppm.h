@@ -0,0 +1,17 @@
+#if !defined(PPM_H)
+#define PPM_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+// Largest image ppm_read accepts: 4 gigapixels, or 256 megapixels where
+// size_t is 32 bits wide, so the RGBA raster size cannot wrap
+#define PPM_MAX_PIXELS ((size_t)1 << (sizeof(size_t) > 4 ? 32 : 28))
+
+int ppm_read(FILE *fp, uint8_t **rgba, int *height, int *width);
+int ppm_write(FILE *fp, uint8_t *rgba, int height, int width);
+int pgm_write(FILE *fp, uint8_t *gray, int height, int width);
+int ppm_decode(uint8_t *data, size_t size, uint8_t **rgba, int *height, int *width);
+int ppm_encode(uint8_t *rgba, int height, int width, uint8_t **data, size_t *size);
+
+#endif
@@ -0,0 +1,44 @@
+/**
+ * WASI Runner
+ *
+ * Runs the WASI build of the core library (build with ./build_wasi.sh) under
+ * Node's built-in WASI, for carving untrusted uploads in a sandbox:
+ *
+ *   node run_wasi.mjs jobs/jobs.txt
+ *
+ * The job list's directory is the only directory the module can see; every
+ * "input output seams" line in it names images in that directory. The module
+ * is compiled once and one instance carves the whole list.
+ */
+
+import { readFile } from "fs/promises";
+import { basename, dirname, resolve } from "path";
+import { fileURLToPath } from "url";
+import { WASI } from "wasi";
+
+const [jobList] = process.argv.slice(2);
+if (!jobList) {
+  console.error("usage: node run_wasi.mjs JOBS");
+  process.exit(2);
+}
+
+const wasmPath = resolve(
+  dirname(fileURLToPath(import.meta.url)),
+  "build/seamcarving_wasi.wasm"
+);
+
+// Only the job list's directory is preopened, as /work
+const wasi = new WASI({
+  version: "preview1",
+  args: ["seamcarving_wasi", `/work/${basename(jobList)}`],
+  env: {},
+  preopens: { "/work": resolve(dirname(jobList)) },
+  returnOnExit: true,
+});
+
+const module = await WebAssembly.compile(await readFile(wasmPath));
+const instance = await WebAssembly.instantiate(module, {
+  wasi_snapshot_preview1: wasi.wasiImport,
+});
+
+process.exitCode = wasi.start(instance);
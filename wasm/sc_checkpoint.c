@@ -0,0 +1,365 @@
+#include "sc_checkpoint.h"
+#include "seamcarving_wasm.h"
+#include "ppm.h"
+#include "sc_tune.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// `carve` removes seams from one image. With --budget MS it trades seam
+// quality for time to finish within MS (carve_seams_budget_ctx), and with
+// --memory MB it trades time for memory by stepping down to smaller DP
+// tables (SC_TABLE_*).
+//
+// Carving a very large image can take long enough that losing the run to a
+// crash or a reboot hurts. With --checkpoint FILE the carve is saved at seam
+// boundaries every --every seconds and picked up from FILE when run again on
+// the same image with the same parameters.
+//
+// A checkpoint is the source image's hash and the carve parameters followed
+// by the seam log, so saving appends the seams found since the last save
+// instead of writing out the raster. Resuming replays the log on the source
+// (replay_seams_ctx) and continues with the saved band state, so a resumed
+// carve removes exactly the seams an uninterrupted one would.
+//
+// File layout, in native byte order:
+//   header: "SCCKPT01", int32 height, width, num_seams, band_margin,
+//           refresh_interval, 0, uint64 FNV-1a hash of the RGBA source
+//   record: int32 count, int32 since_exact, double exact_cost,
+//           int32 starts[count], int16 steps[count * (height - 1)]
+// A record cut short by a crash is dropped on resume.
+
+#define CHECKPOINT_MAGIC "SCCKPT01"
+
+static const char *table_names[SC_NUM_TABLES] = { "full", "bitmap", "linear", "band" };
+
+typedef struct {
+    char magic[8];
+    int32_t height;
+    int32_t width;
+    int32_t num_seams;
+    int32_t band_margin;
+    int32_t refresh_interval;
+    int32_t reserved;
+    uint64_t source_hash;
+} checkpoint_header;
+
+typedef struct {
+    int32_t count;
+    int32_t since_exact;
+    double exact_cost;
+} checkpoint_record;
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+static uint64_t fnv1a(const uint8_t *data, size_t size) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t k = 0; k < size; k++) {
+        hash = (hash ^ data[k]) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+// Replay the records of an open checkpoint onto work and index. Returns the
+// number of seams replayed, or -1 if the log does not fit the image. Leaves
+// fp at the end of the last whole record.
+static int load_checkpoint(FILE *fp, sc_context *ctx, uint8_t *work, int32_t *index, int height,
+                           int width, sc_progress *progress) {
+    int32_t *starts = NULL;
+    int16_t *steps = NULL;
+    int capacity = 0;
+    long good_end = ftell(fp);
+    checkpoint_record record;
+
+    while (fread(&record, sizeof(record), 1, fp) == 1) {
+        int cur_width = width - progress->seams;
+        if (record.count <= 0 || record.count >= cur_width) {
+            break;
+        }
+        if (record.count > capacity) {
+            capacity = record.count;
+            starts = (int32_t *)realloc(starts, capacity * sizeof(int32_t));
+            steps = (int16_t *)realloc(steps, (size_t)capacity * (height - 1) * sizeof(int16_t));
+        }
+        size_t num_steps = (size_t)record.count * (height - 1);
+        if (fread(starts, sizeof(int32_t), record.count, fp) != (size_t)record.count ||
+            fread(steps, sizeof(int16_t), num_steps, fp) != num_steps) {
+            break;
+        }
+        if (replay_seams_ctx(ctx, work, index, height, cur_width, record.count, starts,
+                             steps) < 0) {
+            free(starts);
+            free(steps);
+            return -1;
+        }
+        progress->seams += record.count;
+        progress->since_exact = record.since_exact;
+        progress->exact_cost = record.exact_cost;
+        good_end = ftell(fp);
+    }
+
+    free(starts);
+    free(steps);
+    // Drop a torn record so new records append after the last whole one
+    fseek(fp, good_end, SEEK_SET);
+    if (ftruncate(fileno(fp), good_end) != 0) {
+        return -1;
+    }
+    return progress->seams;
+}
+
+// Append the seams found since the last save and flush them to disk
+static int save_checkpoint(FILE *fp, int height, int count, sc_progress *progress,
+                           int32_t *starts, int16_t *steps) {
+    checkpoint_record record = {count, progress->since_exact, progress->exact_cost};
+    size_t num_steps = (size_t)count * (height - 1);
+
+    if (fwrite(&record, sizeof(record), 1, fp) != 1 ||
+        fwrite(starts, sizeof(int32_t), count, fp) != (size_t)count ||
+        fwrite(steps, sizeof(int16_t), num_steps, fp) != num_steps || fflush(fp) != 0 ||
+        fsync(fileno(fp)) != 0) {
+        return -1;
+    }
+    return 0;
+}
+
+// Open the checkpoint at path and replay it, or start a new one. Returns the
+// open file, or NULL if it belongs to another image or carve.
+static FILE *open_checkpoint(const char *path, checkpoint_header *header, sc_context *ctx,
+                             uint8_t *work, int32_t *index, sc_progress *progress) {
+    FILE *fp = fopen(path, "r+b");
+
+    if (!fp) {
+        fp = fopen(path, "w+b");
+        if (!fp || fwrite(header, sizeof(*header), 1, fp) != 1 || fflush(fp) != 0) {
+            fprintf(stderr, "carve: cannot write checkpoint %s\n", path);
+            if (fp) {
+                fclose(fp);
+            }
+            return NULL;
+        }
+        return fp;
+    }
+
+    checkpoint_header saved;
+    if (fread(&saved, sizeof(saved), 1, fp) != 1 || memcmp(&saved, header, sizeof(saved))) {
+        fprintf(stderr, "carve: %s is a checkpoint of another image or carve\n", path);
+        fclose(fp);
+        return NULL;
+    }
+    if (load_checkpoint(fp, ctx, work, index, header->height, header->width, progress) < 0) {
+        fprintf(stderr, "carve: checkpoint %s does not fit the image\n", path);
+        fclose(fp);
+        return NULL;
+    }
+    fprintf(stderr, "carve: resuming at seam %d of %d\n", progress->seams, header->num_seams);
+    return fp;
+}
+
+// Report the DP tables a carve stepped down to, if any
+static void report_tables(sc_context *ctx) {
+    if (ctx->steps_down == 0) {
+        return;
+    }
+    fprintf(stderr, "carve: stepped down to fit %.1f MB; seams by DP table:",
+            ctx->memory_limit / 1048576.0);
+    for (int t = 0; t < SC_NUM_TABLES; t++) {
+        fprintf(stderr, " %s %ld", table_names[t], ctx->table_seams[t]);
+    }
+    fprintf(stderr, "\n");
+}
+
+// carve --budget: carve within a time budget and report how
+static int carve_budget(uint8_t *pixels, int height, int width, int num_seams, double budget_ms,
+                        size_t memory_limit) {
+    sc_context *ctx = sc_context_create();
+    ctx->memory_limit = memory_limit;
+    sc_budget_report report;
+    uint8_t *carved = carve_seams_budget_ctx(ctx, pixels, height, width, num_seams, budget_ms,
+                                             &report);
+
+    fprintf(stderr,
+            "carve: %d seams in %.1f ms of %.0f: %d exact, %d banded, %d in strips, "
+            "%d resampled\n",
+            num_seams, report.ms, budget_ms, report.seams_exact, report.seams_banded,
+            report.seams_strips, report.seams_resampled);
+    report_tables(ctx);
+    int status = ppm_write(stdout, carved, height, width - num_seams) == 0 ? 0 : 1;
+
+    free(carved);
+    sc_context_destroy(ctx);
+    free(pixels);
+    return status;
+}
+
+int run_carve(int argc, char **argv) {
+    sc_profile profile;
+    sc_use_profile(&profile);
+    int num_seams = -1;
+    int target_width = -1;
+    int band_margin = 0;
+    int refresh_interval = 0;
+    const char *path = NULL;
+    double every_ms = 60000;
+    double budget_ms = 0;
+    size_t memory_limit = 0;
+
+    for (int a = 0; a < argc; a++) {
+        if (!strcmp(argv[a], "--seams") && a + 1 < argc) {
+            num_seams = atoi(argv[++a]);
+        }
+        else if (!strcmp(argv[a], "--width") && a + 1 < argc) {
+            target_width = atoi(argv[++a]);
+        }
+        else if (!strcmp(argv[a], "--band") && a + 1 < argc) {
+            band_margin = atoi(argv[++a]);
+        }
+        else if (!strcmp(argv[a], "--refresh") && a + 1 < argc) {
+            refresh_interval = atoi(argv[++a]);
+        }
+        else if (!strcmp(argv[a], "--checkpoint") && a + 1 < argc) {
+            path = argv[++a];
+        }
+        else if (!strcmp(argv[a], "--every") && a + 1 < argc) {
+            every_ms = atof(argv[++a]) * 1000;
+        }
+        else if (!strcmp(argv[a], "--budget") && a + 1 < argc) {
+            budget_ms = atof(argv[++a]);
+        }
+        else if (!strcmp(argv[a], "--memory") && a + 1 < argc) {
+            memory_limit = (size_t)atoi(argv[++a]) << 20;
+        }
+        else {
+            fprintf(stderr, "carve: unknown option %s\n", argv[a]);
+            return 2;
+        }
+    }
+    if ((num_seams < 0) == (target_width < 0) || band_margin < 0 || refresh_interval < 0) {
+        fprintf(stderr, "carve: give one of --seams or --width\n");
+        return 2;
+    }
+    if (budget_ms < 0 || (budget_ms > 0 && path)) {
+        fprintf(stderr, "carve: --budget must be positive and cannot be checkpointed\n");
+        return 2;
+    }
+
+    uint8_t *pixels;
+    int height, width;
+    if (ppm_read(stdin, &pixels, &height, &width) != 1) {
+        fprintf(stderr, "carve: cannot read a PPM image from stdin\n");
+        return 1;
+    }
+    if (num_seams < 0) {
+        num_seams = width - target_width;
+    }
+    if (num_seams < 0 || num_seams >= width) {
+        fprintf(stderr, "carve: cannot remove %d seams from a %d pixel wide image\n", num_seams,
+                width);
+        free(pixels);
+        return 1;
+    }
+
+    if (budget_ms > 0) {
+        return carve_budget(pixels, height, width, num_seams, budget_ms, memory_limit);
+    }
+
+    sc_context *ctx = sc_context_create();
+    ctx->memory_limit = memory_limit;
+    int32_t *index = (int32_t *)malloc((size_t)height * width * sizeof(int32_t));
+    for (int j = 0; j < height; j++) {
+        for (int i = 0; i < width; i++) {
+            index[(long)j * width + i] = i;
+        }
+    }
+    sc_progress progress = {0, 0, 0};
+    FILE *fp = NULL;
+
+    // The source is carved in place; only its hash is needed from here on
+    if (path) {
+        checkpoint_header header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic));
+        header.height = height;
+        header.width = width;
+        header.num_seams = num_seams;
+        header.band_margin = band_margin;
+        header.refresh_interval = refresh_interval;
+        header.source_hash = fnv1a(pixels, (size_t)height * width * 4);
+
+        fp = open_checkpoint(path, &header, ctx, pixels, index, &progress);
+        if (!fp) {
+            sc_context_destroy(ctx);
+            free(index);
+            free(pixels);
+            return 1;
+        }
+    }
+
+    // Seams found since the last save, grown as needed
+    int32_t *starts = NULL;
+    int16_t *steps = NULL;
+    int pending = 0;
+    int capacity = 0;
+    int status = 0;
+    int resumed = progress.seams;
+    double start = now_ms();
+    double last_save = start;
+    sc_tuning tuning;
+    sc_get_tuning(&tuning);
+
+    while (progress.seams < num_seams) {
+        // Carve as many seams as should fit before the next save in one call,
+        // so the engine can overlap and share work between them
+        int left = num_seams - progress.seams;
+        double seam_ms = (double)height * (width - progress.seams) * tuning.exact_ns / 1e6;
+        double fit = (seam_ms > 0) ? (last_save + every_ms - now_ms()) / seam_ms : left;
+        int batch = (fit >= left) ? left : (fit >= 1) ? (int)fit : 1;
+
+        if (pending + batch > capacity) {
+            while (capacity < pending + batch) {
+                capacity = capacity ? capacity * 2 : 16;
+            }
+            starts = (int32_t *)realloc(starts, capacity * sizeof(int32_t));
+            steps = (int16_t *)realloc(steps, (size_t)capacity * (height - 1) * sizeof(int16_t));
+        }
+        carve_seams_resume_ctx(ctx, pixels, index, height, width - progress.seams, batch,
+                               band_margin, refresh_interval, &progress, starts + pending,
+                               steps + (size_t)pending * (height - 1));
+        pending += batch;
+
+        if (fp && (now_ms() - last_save >= every_ms || progress.seams == num_seams)) {
+            if (save_checkpoint(fp, height, pending, &progress, starts, steps) != 0) {
+                fprintf(stderr, "carve: cannot write checkpoint %s\n", path);
+                status = 1;
+                break;
+            }
+            pending = 0;
+            last_save = now_ms();
+        }
+        else if (!fp) {
+            pending = 0;
+        }
+    }
+
+    if (status == 0) {
+        fprintf(stderr, "carve: %d seams in %.1f ms\n", num_seams - resumed, now_ms() - start);
+        report_tables(ctx);
+        status = ppm_write(stdout, pixels, height, width - num_seams) == 0 ? 0 : 1;
+    }
+
+    if (fp) {
+        fclose(fp);
+    }
+    free(starts);
+    free(steps);
+    sc_context_destroy(ctx);
+    free(index);
+    free(pixels);
+    return status;
+}
@@ -0,0 +1,7 @@
+#if !defined(SC_CHECKPOINT_H)
+#define SC_CHECKPOINT_H
+
+// Long carve with checkpoint and resume: `seamcarving carve`
+int run_carve(int argc, char **argv);
+
+#endif
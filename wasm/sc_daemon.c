@@ -0,0 +1,944 @@
+#include "sc_daemon.h"
+#include "seamcarving_wasm.h"
+#include "ppm.h"
+#include "sc_tune.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <signal.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+// Local carving service. Clients POST a binary PPM to
+//   /carve?width=W   or   /carve?seams=N   (optionally &band=M)
+// and get the carved PPM back.
+//
+// Requests are grouped into seam jobs by content hash and band margin. A
+// request for an image that is already queued or being carved attaches to
+// that job instead of carving again, and requests for different widths of
+// the same image share one seam order (carve_seam_order_ctx) cut down to
+// each width, so a burst of requests costs one carve per image.
+//
+// Jobs are scheduled by class (&priority=interactive, the default, or bulk)
+// and earliest deadline within a class (&deadline=MS from arrival). A job
+// only starts while the estimated memory of running jobs (sc_estimate_bytes)
+// stays under --memory; the rest wait in the queue. A quarter of the budget
+// and one worker are kept for interactive jobs, so a huge backfill cannot
+// hold up interactive requests. A job larger than its class may use is
+// capped to it and carves with smaller DP tables (SC_TABLE_*) instead.
+// Request bodies and the decoded images of queued jobs count against the
+// same budget. A request waits for room until its deadline, and is refused
+// with 503 only if it could never fit or the deadline passes.
+//
+// GET /metrics reports counters and latency histograms in the Prometheus
+// text format. Threads add to their own counter slot with relaxed atomics
+// and a scrape sums the slots, so scraping never takes the job lock.
+
+#define MAX_HEADER 8192
+
+// Priority classes, most urgent first
+enum { CLASS_INTERACTIVE, CLASS_BULK, NUM_CLASSES };
+
+static const char *class_names[NUM_CLASSES] = { "interactive", "bulk" };
+
+// Deadline of a job that does not give one, by class
+static const double default_deadline_ms[NUM_CLASSES] = { 1000, 600000 };
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+// Part 1: HTTP
+typedef struct {
+    char method[8];
+    char path[256];
+    char query[512];
+    uint8_t *body;
+    size_t body_size;
+    size_t held;             // bytes held against the memory budget (hold_bytes)
+    double arrived;          // now_ms when its header was read
+} http_request;
+
+static int write_all(int fd, const void *data, size_t size) {
+    const uint8_t *p = (const uint8_t *)data;
+    while (size > 0) {
+        ssize_t n = write(fd, p, size);
+        if (n <= 0) {
+            return -1;
+        }
+        p += n;
+        size -= n;
+    }
+    return 0;
+}
+
+// Helper function to read an integer query parameter
+static int query_int(const char *query, const char *name, int fallback) {
+    size_t len = strlen(name);
+    for (const char *p = query; p && *p; p = strchr(p, '&') ? strchr(p, '&') + 1 : NULL) {
+        if (!strncmp(p, name, len) && p[len] == '=') {
+            return atoi(p + len + 1);
+        }
+    }
+    return fallback;
+}
+
+// Helper function for a request's priority class
+static int request_class(http_request *req) {
+    return strstr(req->query, "priority=bulk") ? CLASS_BULK : CLASS_INTERACTIVE;
+}
+
+// Helper function for a request's deadline (now_ms)
+static double request_deadline(http_request *req) {
+    int job_class = request_class(req);
+    return req->arrived + query_int(req->query, "deadline", (int)default_deadline_ms[job_class]);
+}
+
+// Memory a PPM body of this size may decode to: at most one RGBA pixel per
+// three bytes, which ppm_decode enforces
+static size_t decoded_bytes(size_t length) {
+    return length / 3 * 4;
+}
+
+static int hold_bytes(size_t n, double deadline);
+
+// Read one request with its body, holding room for it and its decoded
+// image. Returns 0, -1 if it is malformed, -2 if it does not fit the memory
+// budget by its deadline or -3 if its target is too long.
+static int read_request(int fd, http_request *req) {
+    char header[MAX_HEADER + 1];
+    size_t got = 0;
+    char *end = NULL;
+
+    memset(req, 0, sizeof(*req));
+    req->arrived = now_ms();
+    while (!end) {
+        if (got == MAX_HEADER) {
+            return -1;
+        }
+        ssize_t n = read(fd, header + got, MAX_HEADER - got);
+        if (n <= 0) {
+            return -1;
+        }
+        got += n;
+        header[got] = '\0';
+        end = strstr(header, "\r\n\r\n");
+    }
+
+    char target[sizeof(req->path) + sizeof(req->query)];
+    if (sscanf(header, "%7s %767s", req->method, target) != 2) {
+        return -1;
+    }
+    char *query = strchr(target, '?');
+    if (query) {
+        *query++ = '\0';
+        if (snprintf(req->query, sizeof(req->query), "%s", query) >= (int)sizeof(req->query)) {
+            return -3;
+        }
+    }
+    if (snprintf(req->path, sizeof(req->path), "%s", target) >= (int)sizeof(req->path)) {
+        return -3;
+    }
+
+    size_t length = 0;
+    for (char *line = strstr(header, "\r\n"); line && line < end; line = strstr(line + 2, "\r\n")) {
+        if (!strncasecmp(line + 2, "Content-Length:", 15)) {
+            length = strtoul(line + 17, NULL, 10);
+        }
+    }
+    // hold_bytes refuses what exceeds the budget; this keeps the sum from wrapping
+    if (length > SIZE_MAX / 3 ||
+        hold_bytes(length + decoded_bytes(length), request_deadline(req)) != 0) {
+        return -2;
+    }
+    req->held = length + decoded_bytes(length);
+
+    // Part of the body may have arrived with the header
+    size_t have = got - (end + 4 - header);
+    if (have > length) {
+        have = length;
+    }
+    req->body = (uint8_t *)malloc(length > 0 ? length : 1);
+    if (!req->body) {
+        return -1;
+    }
+    req->body_size = length;
+    memcpy(req->body, end + 4, have);
+    while (have < length) {
+        ssize_t n = read(fd, req->body + have, length - have);
+        if (n <= 0) {
+            return -1;
+        }
+        have += n;
+    }
+    return 0;
+}
+
+static void send_response(int fd, int status, const char *reason, const char *type,
+                          const char *extra_headers, const void *body, size_t size) {
+    char header[512];
+    int n = snprintf(header, sizeof(header),
+                     "HTTP/1.1 %d %s\r\nContent-Type: %s\r\nContent-Length: %zu\r\n%s"
+                     "Connection: close\r\n\r\n",
+                     status, reason, type, size, extra_headers ? extra_headers : "");
+    if (write_all(fd, header, n) == 0) {
+        write_all(fd, body, size);
+    }
+}
+
+static void send_error(int fd, int status, const char *reason, const char *message) {
+    send_response(fd, status, reason, "text/plain", NULL, message, strlen(message));
+}
+
+// Part 2: Metrics
+enum { STAGE_QUEUE, STAGE_CARVE, STAGE_CUT, STAGE_ENCODE, NUM_STAGES };
+
+static const char *stage_names[NUM_STAGES] = { "queue", "carve", "cut", "encode" };
+
+// How a request was served
+enum { OUTCOME_NEW, OUTCOME_JOINED, OUTCOME_ERROR, NUM_OUTCOMES };
+
+static const char *outcome_names[NUM_OUTCOMES] = { "new", "joined", "error" };
+
+static const char *table_names[SC_NUM_TABLES] = { "full", "bitmap", "linear", "band" };
+
+#define NUM_BUCKETS 12
+
+// Histogram bucket bounds in seconds
+static const double bucket_bounds[NUM_BUCKETS] = {
+    0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10, 30
+};
+
+typedef struct {
+    atomic_long buckets[NUM_BUCKETS + 1];    // the last one is +Inf
+    atomic_long sum_us;
+} histogram;
+
+// One thread's counters, on cache lines of its own
+typedef struct {
+    atomic_long requests[NUM_CLASSES][NUM_OUTCOMES];
+    histogram request_seconds[NUM_CLASSES];
+    histogram stage_seconds[NUM_STAGES];
+    atomic_long carves;
+    atomic_long seams;
+    atomic_long pixels;          // height * width summed over every seam found
+    atomic_long table_seams[SC_NUM_TABLES];
+    atomic_long steps_down;      // DP tables stepped down to fit a job's memory
+    atomic_long deferred;        // jobs that had to wait for memory
+    atomic_long rejected[NUM_CLASSES];   // requests refused for memory (503)
+    atomic_long deadlines_missed;
+} __attribute__((aligned(64))) stat_slot;
+
+// Threads beyond this many share slots, which stays correct since the
+// counters are atomic
+#define NUM_STAT_SLOTS 64
+
+static stat_slot stat_slots[NUM_STAT_SLOTS];
+static atomic_int next_stat_slot;
+static _Thread_local stat_slot *thread_slot;
+
+// Levels rather than counts, kept next to the locked scheduler state
+static atomic_long queued_jobs[NUM_CLASSES];
+static atomic_long running_jobs[NUM_CLASSES];
+static atomic_long admitted_bytes;
+static atomic_long request_bytes;
+static atomic_long workspace_peak_bytes;
+
+static stat_slot *stats(void) {
+    if (!thread_slot) {
+        thread_slot = &stat_slots[atomic_fetch_add(&next_stat_slot, 1) % NUM_STAT_SLOTS];
+    }
+    return thread_slot;
+}
+
+static void count(atomic_long *counter, long n) {
+    atomic_fetch_add_explicit(counter, n, memory_order_relaxed);
+}
+
+static void observe(histogram *h, double ms) {
+    int b = 0;
+    while (b < NUM_BUCKETS && ms > bucket_bounds[b] * 1000) {
+        b++;
+    }
+    count(&h->buckets[b], 1);
+    count(&h->sum_us, (long)(ms * 1000));
+}
+
+static void raise_peak(atomic_long *peak, long value) {
+    long seen = atomic_load_explicit(peak, memory_order_relaxed);
+    while (value > seen && !atomic_compare_exchange_weak(peak, &seen, value)) {
+    }
+}
+
+// Helper function to sum one counter over every slot
+#define SUM_SLOTS(field) ({                                                  \
+    long total_ = 0;                                                         \
+    for (int k_ = 0; k_ < NUM_STAT_SLOTS; k_++) {                            \
+        total_ += atomic_load_explicit(&stat_slots[k_].field, memory_order_relaxed); \
+    }                                                                        \
+    total_;                                                                  \
+})
+
+static void write_histogram(FILE *out, const char *name, const char *labels, size_t offset) {
+    long cumulative = 0;
+    for (int b = 0; b <= NUM_BUCKETS; b++) {
+        for (int k = 0; k < NUM_STAT_SLOTS; k++) {
+            histogram *h = (histogram *)((char *)&stat_slots[k] + offset);
+            cumulative += atomic_load_explicit(&h->buckets[b], memory_order_relaxed);
+        }
+        if (b < NUM_BUCKETS) {
+            fprintf(out, "%s_bucket{%s,le=\"%g\"} %ld\n", name, labels, bucket_bounds[b], cumulative);
+        }
+        else {
+            fprintf(out, "%s_bucket{%s,le=\"+Inf\"} %ld\n", name, labels, cumulative);
+        }
+    }
+
+    long sum_us = 0;
+    for (int k = 0; k < NUM_STAT_SLOTS; k++) {
+        histogram *h = (histogram *)((char *)&stat_slots[k] + offset);
+        sum_us += atomic_load_explicit(&h->sum_us, memory_order_relaxed);
+    }
+    fprintf(out, "%s_sum{%s} %.6f\n", name, labels, sum_us / 1e6);
+    fprintf(out, "%s_count{%s} %ld\n", name, labels, cumulative);
+}
+
+// Part 3: Seam jobs
+enum { JOB_QUEUED, JOB_RUNNING, JOB_DONE, JOB_FAILED };
+
+typedef struct seam_job {
+    uint64_t hash;
+    uint8_t *data;           // the encoded image as received, to confirm a hash match
+    size_t size;
+    uint8_t *pixels;
+    int height;
+    int width;
+    int band_margin;
+    int num_seams;           // most seams any attached request needs
+    int state;
+    int32_t *order;          // see carve_seam_order_ctx
+    int refs;                // requests attached and not yet answered
+    int job_class;           // most urgent class of the attached requests
+    double deadline;         // earliest deadline of the attached requests (now_ms)
+    double queued_at;
+    size_t bytes;            // estimated memory while carving
+    size_t held;             // of service.held_bytes, given up when it starts
+    int deferred;            // counted in the deferrals yet
+    struct seam_job *next;       // in the in-flight list
+    struct seam_job *next_queued;
+    pthread_cond_t done;
+} seam_job;
+
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t work;
+    pthread_cond_t room;     // signalled when held or running memory is given back
+    seam_job *inflight;
+    seam_job *queued;        // unordered; pick_job applies the policy
+    int default_band;
+    int workers;
+    size_t budget_bytes;
+    size_t running_bytes[NUM_CLASSES];
+    int running[NUM_CLASSES];
+    size_t held_bytes;       // request bodies and decoded images not running yet
+} service_state;
+
+static service_state service;
+
+// Hold n bytes of request data against the memory budget, waiting until
+// deadline (now_ms) for running jobs and other requests to make room.
+// Returns 0, or -1 if they can never fit or the deadline passes first.
+static int hold_bytes(size_t n, double deadline) {
+    if (n > service.budget_bytes) {
+        return -1;
+    }
+
+    pthread_mutex_lock(&service.lock);
+    for (;;) {
+        size_t total = service.running_bytes[CLASS_INTERACTIVE] +
+                       service.running_bytes[CLASS_BULK] + service.held_bytes;
+        if (n == 0 || (total <= service.budget_bytes && n <= service.budget_bytes - total)) {
+            break;
+        }
+        double left = deadline - now_ms();
+        if (left <= 0) {
+            pthread_mutex_unlock(&service.lock);
+            return -1;
+        }
+        // service.room runs on CLOCK_MONOTONIC, like now_ms
+        struct timespec until;
+        clock_gettime(CLOCK_MONOTONIC, &until);
+        long ns = until.tv_nsec + (long)(fmod(left, 1000) * 1e6);
+        until.tv_sec += (time_t)(left / 1000) + ns / 1000000000;
+        until.tv_nsec = ns % 1000000000;
+        pthread_cond_timedwait(&service.room, &service.lock, &until);
+    }
+    service.held_bytes += n;
+    count(&request_bytes, (long)n);
+    pthread_mutex_unlock(&service.lock);
+    return 0;
+}
+
+// Give back bytes taken by hold_bytes. Call with the lock held.
+static void drop_bytes(size_t n) {
+    service.held_bytes -= n;
+    count(&request_bytes, -(long)n);
+    if (n > 0) {
+        pthread_cond_broadcast(&service.room);
+    }
+}
+
+
+static uint64_t fnv1a(const uint8_t *data, size_t size) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t k = 0; k < size; k++) {
+        hash = (hash ^ data[k]) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+// Find a job a request can attach to: the same image and band margin, and
+// either still queued (so its seam count can grow) or carving deep enough.
+// Call with the lock held.
+static seam_job *find_job(uint64_t hash, http_request *req, int band_margin, int num_seams,
+                          int target_width) {
+    for (seam_job *job = service.inflight; job; job = job->next) {
+        if (job->hash != hash || job->size != req->body_size || job->band_margin != band_margin ||
+            job->state == JOB_FAILED || memcmp(job->data, req->body, job->size) != 0) {
+            continue;
+        }
+        int need = (num_seams >= 0) ? num_seams : job->width - target_width;
+        if (job->state == JOB_QUEUED || need <= job->num_seams) {
+            return job;
+        }
+    }
+    return NULL;
+}
+
+static void release_job(seam_job *job) {
+    if (--job->refs > 0) {
+        return;
+    }
+    for (seam_job **p = &service.inflight; *p; p = &(*p)->next) {
+        if (*p == job) {
+            *p = job->next;
+            break;
+        }
+    }
+    pthread_cond_destroy(&job->done);
+    free(job->data);
+    free(job->pixels);
+    free(job->order);
+    free(job);
+}
+
+// Memory a job may hold: its estimate, capped at what its class may have
+// running. A capped job steps down to smaller DP tables to stay within it.
+static size_t job_bytes(seam_job *job) {
+    size_t cap = (job->job_class == CLASS_INTERACTIVE)
+                     ? service.budget_bytes
+                     : service.budget_bytes - service.budget_bytes / 4;
+    return (job->bytes < cap) ? job->bytes : cap;
+}
+
+// Whether a job may start now without breaking the memory budget or the
+// share kept for interactive jobs. The total counts the data other
+// requests hold, but not the job's own, which its estimate includes. A job
+// may always start when nothing is running, so an oversized job runs alone
+// instead of waiting forever.
+static int admissible(seam_job *job) {
+    size_t reserve = service.budget_bytes / 4;
+    size_t total = service.running_bytes[CLASS_INTERACTIVE] + service.running_bytes[CLASS_BULK] +
+                   service.held_bytes - job->held;
+    size_t bytes = job_bytes(job);
+
+    if (service.running[CLASS_INTERACTIVE] + service.running[CLASS_BULK] == 0) {
+        return 1;
+    }
+    if (job->job_class == CLASS_INTERACTIVE) {
+        return total + bytes <= service.budget_bytes;
+    }
+    if (service.workers > 1 && service.running[CLASS_BULK] >= service.workers - 1) {
+        return 0;
+    }
+    return total + bytes <= service.budget_bytes - reserve;
+}
+
+// Take the next job to run: the earliest deadline of the most urgent class
+// that has queued jobs and may start. Jobs of a class start in deadline
+// order, so a large job is never overtaken forever by smaller ones of its
+// class. Call with the lock held; returns NULL if nothing may start.
+static seam_job *pick_job(void) {
+    for (int c = 0; c < NUM_CLASSES; c++) {
+        seam_job **best = NULL;
+        for (seam_job **p = &service.queued; *p; p = &(*p)->next_queued) {
+            if ((*p)->job_class == c && (!best || (*p)->deadline < (*best)->deadline)) {
+                best = p;
+            }
+        }
+        if (!best) {
+            continue;
+        }
+        if (!admissible(*best)) {
+            // Count each job once, not every time it is looked at again
+            if (!(*best)->deferred) {
+                (*best)->deferred = 1;
+                count(&stats()->deferred, 1);
+            }
+            continue;
+        }
+
+        seam_job *job = *best;
+        *best = job->next_queued;
+        count(&queued_jobs[c], -1);
+        return job;
+    }
+    return NULL;
+}
+
+static void *carve_worker(void *arg) {
+    sc_context *ctx = sc_context_create();
+    (void)arg;
+
+    pthread_mutex_lock(&service.lock);
+    for (;;) {
+        seam_job *job;
+        while ((job = pick_job()) == NULL) {
+            pthread_cond_wait(&service.work, &service.lock);
+        }
+        job->state = JOB_RUNNING;
+        // Its data now counts in its estimate instead
+        drop_bytes(job->held);
+        job->held = 0;
+        int num_seams = job->num_seams;
+        int job_class = job->job_class;
+        size_t bytes = job_bytes(job);
+        // The context gets what the cap leaves next to the job's other buffers
+        size_t pixels = (size_t)job->height * job->width;
+        size_t outside = job->bytes - sc_workspace_bytes(job->height, job->width) - pixels * 4;
+        ctx->memory_limit = (bytes == job->bytes) ? 0 : (bytes > outside) ? bytes - outside : 1;
+        service.running[job_class]++;
+        service.running_bytes[job_class] += bytes;
+        count(&running_jobs[job_class], 1);
+        count(&admitted_bytes, (long)bytes);
+        double start = now_ms();
+        observe(&stats()->stage_seconds[STAGE_QUEUE], start - job->queued_at);
+        pthread_mutex_unlock(&service.lock);
+
+        int32_t *order = (int32_t *)malloc((size_t)job->height * job->width * sizeof(int32_t));
+        int status = order ? carve_seam_order_ctx(ctx, job->pixels, job->height, job->width,
+                                                  num_seams, job->band_margin, 0, order)
+                           : -1;
+        double ms = now_ms() - start;
+
+        stat_slot *slot = stats();
+        observe(&slot->stage_seconds[STAGE_CARVE], ms);
+        if (status == 0) {
+            count(&slot->carves, 1);
+            count(&slot->seams, num_seams);
+            count(&slot->pixels, (long)job->height * job->width * num_seams);
+        }
+        for (int t = 0; t < SC_NUM_TABLES; t++) {
+            count(&slot->table_seams[t], ctx->table_seams[t]);
+            ctx->table_seams[t] = 0;
+        }
+        count(&slot->steps_down, ctx->steps_down);
+        ctx->steps_down = 0;
+        raise_peak(&workspace_peak_bytes, (long)ctx->peak_bytes);
+
+        // Give the job's memory back before the next pick; the order moves
+        // to the requesters, whose output buffers are small next to it
+        sc_context_reset(ctx);
+
+        pthread_mutex_lock(&service.lock);
+        job->order = order;
+        job->state = (status == 0) ? JOB_DONE : JOB_FAILED;
+        service.running[job_class]--;
+        service.running_bytes[job_class] -= bytes;
+        count(&running_jobs[job_class], -1);
+        count(&admitted_bytes, -(long)bytes);
+        if (now_ms() > job->deadline) {
+            count(&slot->deadlines_missed, 1);
+        }
+        fprintf(stderr, "serve: %dx%d, %d seams for %d %s requests in %.1f ms\n", job->width,
+                job->height, num_seams, job->refs, class_names[job_class], ms);
+        pthread_cond_broadcast(&job->done);
+        // Memory was freed, so a deferred job or a waiting request may fit now
+        pthread_cond_broadcast(&service.work);
+        pthread_cond_broadcast(&service.room);
+    }
+    return NULL;
+}
+
+// Part 4: Requests
+static void handle_metrics(int fd) {
+    char *text = NULL;
+    size_t size = 0;
+    FILE *out = open_memstream(&text, &size);
+    char labels[64];
+
+    fprintf(out, "# HELP sc_requests_total Carve requests by class and how they were served.\n"
+                 "# TYPE sc_requests_total counter\n");
+    for (int c = 0; c < NUM_CLASSES; c++) {
+        for (int o = 0; o < NUM_OUTCOMES; o++) {
+            fprintf(out, "sc_requests_total{class=\"%s\",outcome=\"%s\"} %ld\n", class_names[c],
+                    outcome_names[o], SUM_SLOTS(requests[c][o]));
+        }
+    }
+
+    fprintf(out, "# HELP sc_request_duration_seconds Time from request to response.\n"
+                 "# TYPE sc_request_duration_seconds histogram\n");
+    for (int c = 0; c < NUM_CLASSES; c++) {
+        snprintf(labels, sizeof(labels), "class=\"%s\"", class_names[c]);
+        write_histogram(out, "sc_request_duration_seconds", labels,
+                        offsetof(stat_slot, request_seconds) + c * sizeof(histogram));
+    }
+
+    fprintf(out, "# HELP sc_stage_duration_seconds Time spent queued, carving the seam order,\n"
+                 "# cutting it to a width and encoding the result.\n"
+                 "# TYPE sc_stage_duration_seconds histogram\n");
+    for (int st = 0; st < NUM_STAGES; st++) {
+        snprintf(labels, sizeof(labels), "stage=\"%s\"", stage_names[st]);
+        write_histogram(out, "sc_stage_duration_seconds", labels,
+                        offsetof(stat_slot, stage_seconds) + st * sizeof(histogram));
+    }
+
+    fprintf(out, "# HELP sc_carves_total Seam orders computed.\n"
+                 "# TYPE sc_carves_total counter\n"
+                 "sc_carves_total %ld\n"
+                 "# HELP sc_seams_total Seams found.\n"
+                 "# TYPE sc_seams_total counter\n"
+                 "sc_seams_total %ld\n"
+                 "# HELP sc_pixels_total Pixels searched, height * width per seam.\n"
+                 "# TYPE sc_pixels_total counter\n"
+                 "sc_pixels_total %ld\n"
+                 "# HELP sc_admission_deferrals_total Jobs that waited for memory to start.\n"
+                 "# TYPE sc_admission_deferrals_total counter\n"
+                 "sc_admission_deferrals_total %ld\n"
+                 "# HELP sc_deadlines_missed_total Jobs finished after their deadline.\n"
+                 "# TYPE sc_deadlines_missed_total counter\n"
+                 "sc_deadlines_missed_total %ld\n",
+            SUM_SLOTS(carves), SUM_SLOTS(seams), SUM_SLOTS(pixels), SUM_SLOTS(deferred),
+            SUM_SLOTS(deadlines_missed));
+
+    fprintf(out, "# HELP sc_admission_rejections_total Requests refused with 503 because they\n"
+                 "# could not fit the memory budget by their deadline.\n"
+                 "# TYPE sc_admission_rejections_total counter\n");
+    for (int c = 0; c < NUM_CLASSES; c++) {
+        fprintf(out, "sc_admission_rejections_total{class=\"%s\"} %ld\n", class_names[c],
+                SUM_SLOTS(rejected[c]));
+    }
+
+    fprintf(out, "# HELP sc_table_seams_total Seams found by how their DP was stored.\n"
+                 "# TYPE sc_table_seams_total counter\n");
+    for (int t = 0; t < SC_NUM_TABLES; t++) {
+        fprintf(out, "sc_table_seams_total{table=\"%s\"} %ld\n", table_names[t],
+                SUM_SLOTS(table_seams[t]));
+    }
+    fprintf(out, "# HELP sc_table_steps_down_total DP tables stepped down to fit a job's memory.\n"
+                 "# TYPE sc_table_steps_down_total counter\n"
+                 "sc_table_steps_down_total %ld\n",
+            SUM_SLOTS(steps_down));
+
+    fprintf(out, "# HELP sc_queued_jobs Jobs waiting for a worker.\n"
+                 "# TYPE sc_queued_jobs gauge\n");
+    for (int c = 0; c < NUM_CLASSES; c++) {
+        fprintf(out, "sc_queued_jobs{class=\"%s\"} %ld\n", class_names[c],
+                atomic_load(&queued_jobs[c]));
+    }
+    fprintf(out, "# HELP sc_running_jobs Jobs being carved.\n"
+                 "# TYPE sc_running_jobs gauge\n");
+    for (int c = 0; c < NUM_CLASSES; c++) {
+        fprintf(out, "sc_running_jobs{class=\"%s\"} %ld\n", class_names[c],
+                atomic_load(&running_jobs[c]));
+    }
+    fprintf(out, "# HELP sc_admitted_bytes Estimated memory of running jobs.\n"
+                 "# TYPE sc_admitted_bytes gauge\n"
+                 "sc_admitted_bytes %ld\n"
+                 "# HELP sc_request_bytes Request bodies and decoded images not running yet.\n"
+                 "# TYPE sc_request_bytes gauge\n"
+                 "sc_request_bytes %ld\n"
+                 "# HELP sc_memory_budget_bytes Memory budget for running jobs and held requests.\n"
+                 "# TYPE sc_memory_budget_bytes gauge\n"
+                 "sc_memory_budget_bytes %zu\n"
+                 "# HELP sc_workspace_peak_bytes Largest working set any worker context held.\n"
+                 "# TYPE sc_workspace_peak_bytes gauge\n"
+                 "sc_workspace_peak_bytes %ld\n",
+            atomic_load(&admitted_bytes), atomic_load(&request_bytes), service.budget_bytes,
+            atomic_load(&workspace_peak_bytes));
+
+    fclose(out);
+    send_response(fd, 200, "OK", "text/plain; version=0.0.4", NULL, text, size);
+    free(text);
+}
+
+// Serve a carve request; returns its OUTCOME_* and sets *req_class
+static int handle_carve(int fd, http_request *req, int *req_class) {
+    int job_class = request_class(req);
+    *req_class = job_class;
+    int num_seams = query_int(req->query, "seams", -1);
+    int target_width = query_int(req->query, "width", -1);
+    int band_margin = query_int(req->query, "band", service.default_band);
+    if ((num_seams < 0) == (target_width < 0) || band_margin < 0) {
+        send_error(fd, 400, "Bad Request", "give one of seams or width\n");
+        return OUTCOME_ERROR;
+    }
+    double deadline = request_deadline(req);
+
+    uint64_t hash = fnv1a(req->body, req->body_size);
+    int outcome = OUTCOME_JOINED;
+
+    pthread_mutex_lock(&service.lock);
+    seam_job *job = find_job(hash, req, band_margin, num_seams, target_width);
+    if (job) {
+        // Joining, so the room held for decoding is not needed
+        drop_bytes(req->held - req->body_size);
+        req->held = req->body_size;
+    }
+    else {
+        // Decode outside the lock, then look again in case a twin got in first.
+        // read_request held room for the largest image the body can hold.
+        pthread_mutex_unlock(&service.lock);
+        uint8_t *pixels;
+        int height, width;
+        if (ppm_decode(req->body, req->body_size, &pixels, &height, &width) != 1) {
+            send_error(fd, 400, "Bad Request", "body must be a binary PPM image\n");
+            return OUTCOME_ERROR;
+        }
+        int need = (num_seams >= 0) ? num_seams : width - target_width;
+        if (need < 0 || need >= width) {
+            free(pixels);
+            send_error(fd, 400, "Bad Request", "cannot remove that many seams\n");
+            return OUTCOME_ERROR;
+        }
+
+        size_t pixel_bytes = (size_t)height * width * 4;
+        pthread_mutex_lock(&service.lock);
+        drop_bytes(req->held - req->body_size - pixel_bytes);
+        req->held = req->body_size + pixel_bytes;
+        job = find_job(hash, req, band_margin, num_seams, target_width);
+        if (job) {
+            free(pixels);
+            drop_bytes(pixel_bytes);
+            req->held -= pixel_bytes;
+        }
+        else {
+            job = (seam_job *)calloc(1, sizeof(seam_job));
+            job->hash = hash;
+            job->data = req->body;
+            job->size = req->body_size;
+            req->body = NULL;
+            job->held = req->held;
+            req->held = 0;
+            job->pixels = pixels;
+            job->height = height;
+            job->width = width;
+            job->band_margin = band_margin;
+            job->num_seams = 0;
+            job->state = JOB_QUEUED;
+            job->job_class = job_class;
+            job->deadline = deadline;
+            job->queued_at = now_ms();
+            job->bytes = sc_estimate_bytes(height, width, SC_MODE_ORDER) +
+                         (size_t)height * width * 4 + job->size;
+            pthread_cond_init(&job->done, NULL);
+            job->next = service.inflight;
+            service.inflight = job;
+            job->next_queued = service.queued;
+            service.queued = job;
+            count(&queued_jobs[job_class], 1);
+            outcome = OUTCOME_NEW;
+        }
+    }
+
+    int need = (num_seams >= 0) ? num_seams : job->width - target_width;
+    if (need < 0 || need >= job->width) {
+        pthread_mutex_unlock(&service.lock);
+        send_error(fd, 400, "Bad Request", "cannot remove that many seams\n");
+        return OUTCOME_ERROR;
+    }
+    if (job->state == JOB_QUEUED) {
+        // Still queued, so the carve can go deeper and move up to the most
+        // urgent request waiting on it
+        if (need > job->num_seams) {
+            job->num_seams = need;
+        }
+        if (job_class < job->job_class) {
+            count(&queued_jobs[job->job_class], -1);
+            count(&queued_jobs[job_class], 1);
+            job->job_class = job_class;
+        }
+        if (deadline < job->deadline) {
+            job->deadline = deadline;
+        }
+        pthread_cond_broadcast(&service.work);
+    }
+    job->refs++;
+    while (job->state == JOB_QUEUED || job->state == JOB_RUNNING) {
+        pthread_cond_wait(&job->done, &service.lock);
+    }
+    pthread_mutex_unlock(&service.lock);
+
+    // The order is read-only once done, so cutting it down needs no lock
+    uint8_t *encoded = NULL;
+    size_t size = 0;
+    int ok = 0;
+    if (job->state == JOB_DONE) {
+        stat_slot *slot = stats();
+        double start = now_ms();
+        uint8_t *carved = (uint8_t *)malloc((size_t)job->height * (job->width - need) * 4);
+        apply_seam_order(job->pixels, job->height, job->width, job->order, need, carved);
+        double cut = now_ms();
+        observe(&slot->stage_seconds[STAGE_CUT], cut - start);
+        ok = ppm_encode(carved, job->height, job->width - need, &encoded, &size) == 0;
+        observe(&slot->stage_seconds[STAGE_ENCODE], now_ms() - cut);
+        free(carved);
+    }
+
+    pthread_mutex_lock(&service.lock);
+    release_job(job);
+    pthread_mutex_unlock(&service.lock);
+
+    if (ok) {
+        char headers[64];
+        snprintf(headers, sizeof(headers), "X-Carve-Job: %s\r\n", outcome_names[outcome]);
+        send_response(fd, 200, "OK", "image/x-portable-pixmap", headers, encoded, size);
+    }
+    else {
+        send_error(fd, 500, "Internal Server Error", "carve failed\n");
+        outcome = OUTCOME_ERROR;
+    }
+    free(encoded);
+    return outcome;
+}
+
+static void *handle_connection(void *arg) {
+    int fd = (int)(intptr_t)arg;
+    http_request req;
+    int status = read_request(fd, &req);
+
+    if (status == -2) {
+        count(&stats()->rejected[request_class(&req)], 1);
+        send_error(fd, 503, "Service Unavailable", "request does not fit the memory budget\n");
+    }
+    else if (status == -3) {
+        send_error(fd, 414, "URI Too Long", "request target is too long\n");
+    }
+    else if (status != 0) {
+        send_error(fd, 400, "Bad Request", "malformed request\n");
+    }
+    else if (!strcmp(req.path, "/carve")) {
+        if (strcmp(req.method, "POST")) {
+            send_error(fd, 405, "Method Not Allowed", "POST an image to /carve\n");
+        }
+        else {
+            double start = now_ms();
+            int req_class;
+            int outcome = handle_carve(fd, &req, &req_class);
+            stat_slot *slot = stats();
+            count(&slot->requests[req_class][outcome], 1);
+            observe(&slot->request_seconds[req_class], now_ms() - start);
+        }
+    }
+    else if (!strcmp(req.path, "/metrics")) {
+        handle_metrics(fd);
+    }
+    else {
+        send_error(fd, 404, "Not Found", "not found\n");
+    }
+
+    free(req.body);
+    if (req.held > 0) {
+        pthread_mutex_lock(&service.lock);
+        drop_bytes(req.held);
+        pthread_mutex_unlock(&service.lock);
+    }
+    close(fd);
+    return NULL;
+}
+
+int run_serve(int argc, char **argv) {
+    sc_profile profile;
+    sc_use_profile(&profile);
+    int port = 8080;
+    int workers = profile.carve_workers > 2 ? profile.carve_workers : 2;
+    int memory_mb = 1024;
+
+    memset(&service, 0, sizeof(service));
+    for (int a = 0; a < argc; a++) {
+        if (!strcmp(argv[a], "--port") && a + 1 < argc) {
+            port = atoi(argv[++a]);
+        }
+        else if (!strcmp(argv[a], "--workers") && a + 1 < argc) {
+            workers = atoi(argv[++a]);
+        }
+        else if (!strcmp(argv[a], "--band") && a + 1 < argc) {
+            service.default_band = atoi(argv[++a]);
+        }
+        else if (!strcmp(argv[a], "--memory") && a + 1 < argc) {
+            memory_mb = atoi(argv[++a]);
+        }
+        else {
+            fprintf(stderr, "serve: unknown option %s\n", argv[a]);
+            return 2;
+        }
+    }
+    if (workers < 1 || memory_mb < 1) {
+        fprintf(stderr, "serve: --workers and --memory must be positive\n");
+        return 2;
+    }
+    service.workers = workers;
+    service.budget_bytes = (size_t)memory_mb << 20;
+
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    int yes = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(listener, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(listener, 64) != 0) {
+        perror("serve");
+        return 1;
+    }
+
+    // A client hanging up mid-response must not kill the service
+    signal(SIGPIPE, SIG_IGN);
+    pthread_mutex_init(&service.lock, NULL);
+    pthread_cond_init(&service.work, NULL);
+    pthread_condattr_t room_attr;
+    pthread_condattr_init(&room_attr);
+    pthread_condattr_setclock(&room_attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&service.room, &room_attr);
+    pthread_condattr_destroy(&room_attr);
+    for (int k = 0; k < workers; k++) {
+        pthread_t thread;
+        pthread_create(&thread, NULL, carve_worker, NULL);
+        pthread_detach(thread);
+    }
+    fprintf(stderr, "serve: listening on 127.0.0.1:%d with %d carve workers and %d MB\n", port,
+            workers, memory_mb);
+
+    for (;;) {
+        int fd = accept(listener, NULL, NULL);
+        if (fd < 0) {
+            continue;
+        }
+        pthread_t thread;
+        pthread_create(&thread, NULL, handle_connection, (void *)(intptr_t)fd);
+        pthread_detach(thread);
+    }
+    return 0;
+}
@@ -0,0 +1,7 @@
+#if !defined(SC_DAEMON_H)
+#define SC_DAEMON_H
+
+// Local HTTP carving service: `seamcarving serve`
+int run_serve(int argc, char **argv);
+
+#endif
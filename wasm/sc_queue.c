@@ -0,0 +1,147 @@
+#include "sc_queue.h"
+#include <stdlib.h>
+#include <sched.h>
+#include <time.h>
+
+// The capacity is rounded up to a power of two. Returns 0 on success.
+int sc_queue_init(sc_queue *q, size_t capacity, int producers) {
+    size_t size = 2;
+    while (size < capacity) {
+        size *= 2;
+    }
+
+    q->cells = (sc_queue_cell *)malloc(size * sizeof(sc_queue_cell));
+    if (!q->cells) {
+        return -1;
+    }
+    for (size_t i = 0; i < size; i++) {
+        atomic_init(&q->cells[i].seq, i);
+    }
+    q->mask = size - 1;
+    atomic_init(&q->head, 0);
+    atomic_init(&q->tail, 0);
+    atomic_init(&q->producers, producers);
+    atomic_init(&q->closed, producers <= 0);
+    atomic_init(&q->max_depth, 0);
+    atomic_init(&q->depth_sum, 0);
+    atomic_init(&q->pushes, 0);
+    return 0;
+}
+
+void sc_queue_destroy(sc_queue *q) {
+    free(q->cells);
+}
+
+// Spin briefly, then yield, then sleep so a waiting thread does not steal
+// the core from the stage it is waiting on
+static void backoff(int *spins) {
+    if (*spins < 64) {
+        (*spins)++;
+    }
+    else if (*spins < 128) {
+        (*spins)++;
+        sched_yield();
+    }
+    else {
+        struct timespec ts = { 0, 50000 };
+        nanosleep(&ts, NULL);
+    }
+}
+
+// Every cell carries a sequence number telling whether it is free for the
+// producer at position pos (seq == pos) or holds an item for the consumer at
+// position pos (seq == pos + 1).
+int sc_queue_try_push(sc_queue *q, void *item) {
+    size_t pos = atomic_load_explicit(&q->tail, memory_order_relaxed);
+
+    for (;;) {
+        sc_queue_cell *cell = &q->cells[pos & q->mask];
+        size_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+        long diff = (long)seq - (long)pos;
+
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&q->tail, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                cell->item = item;
+                atomic_store_explicit(&cell->seq, pos + 1, memory_order_release);
+                break;
+            }
+        }
+        else if (diff < 0) {
+            return 0;   // full
+        }
+        else {
+            pos = atomic_load_explicit(&q->tail, memory_order_relaxed);
+        }
+    }
+
+    long depth = sc_queue_depth(q);
+    long max = atomic_load_explicit(&q->max_depth, memory_order_relaxed);
+    while (depth > max &&
+           !atomic_compare_exchange_weak_explicit(&q->max_depth, &max, depth,
+                                                  memory_order_relaxed, memory_order_relaxed)) {
+    }
+    atomic_fetch_add_explicit(&q->depth_sum, depth, memory_order_relaxed);
+    atomic_fetch_add_explicit(&q->pushes, 1, memory_order_relaxed);
+    return 1;
+}
+
+void sc_queue_push(sc_queue *q, void *item) {
+    int spins = 0;
+    while (!sc_queue_try_push(q, item)) {
+        backoff(&spins);
+    }
+}
+
+void *sc_queue_try_pop(sc_queue *q) {
+    size_t pos = atomic_load_explicit(&q->head, memory_order_relaxed);
+
+    for (;;) {
+        sc_queue_cell *cell = &q->cells[pos & q->mask];
+        size_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+        long diff = (long)seq - (long)(pos + 1);
+
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&q->head, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                void *item = cell->item;
+                atomic_store_explicit(&cell->seq, pos + q->mask + 1, memory_order_release);
+                return item;
+            }
+        }
+        else if (diff < 0) {
+            return NULL;   // empty
+        }
+        else {
+            pos = atomic_load_explicit(&q->head, memory_order_relaxed);
+        }
+    }
+}
+
+// Waits for an item; returns NULL once the queue is closed and empty
+void *sc_queue_pop(sc_queue *q) {
+    int spins = 0;
+    for (;;) {
+        void *item = sc_queue_try_pop(q);
+        if (item) {
+            return item;
+        }
+        if (atomic_load_explicit(&q->closed, memory_order_acquire)) {
+            // Producers finish pushing before closing, so one more look is final
+            return sc_queue_try_pop(q);
+        }
+        backoff(&spins);
+    }
+}
+
+void sc_queue_producer_done(sc_queue *q) {
+    if (atomic_fetch_sub_explicit(&q->producers, 1, memory_order_acq_rel) == 1) {
+        atomic_store_explicit(&q->closed, 1, memory_order_release);
+    }
+}
+
+long sc_queue_depth(sc_queue *q) {
+    long depth = (long)atomic_load_explicit(&q->tail, memory_order_relaxed) -
+                 (long)atomic_load_explicit(&q->head, memory_order_relaxed);
+    return depth < 0 ? 0 : depth;
+}
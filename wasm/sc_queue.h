@@ -0,0 +1,37 @@
+#if !defined(SC_QUEUE_H)
+#define SC_QUEUE_H
+
+#include <stddef.h>
+#include <stdatomic.h>
+
+typedef struct {
+    atomic_size_t seq;
+    void *item;
+} sc_queue_cell;
+
+// Bounded lock-free multi-producer/multi-consumer queue. Pushing to a full
+// queue waits, which is what gives a pipeline its backpressure. The queue is
+// closed once every producer has called sc_queue_producer_done, after which
+// sc_queue_pop returns NULL when the queue runs empty.
+typedef struct {
+    sc_queue_cell *cells;
+    size_t mask;
+    atomic_size_t head;
+    atomic_size_t tail;
+    atomic_int producers;
+    atomic_int closed;
+    atomic_long max_depth;
+    atomic_long depth_sum;
+    atomic_long pushes;
+} sc_queue;
+
+int sc_queue_init(sc_queue *q, size_t capacity, int producers);
+void sc_queue_destroy(sc_queue *q);
+int sc_queue_try_push(sc_queue *q, void *item);
+void sc_queue_push(sc_queue *q, void *item);
+void *sc_queue_try_pop(sc_queue *q);
+void *sc_queue_pop(sc_queue *q);
+void sc_queue_producer_done(sc_queue *q);
+long sc_queue_depth(sc_queue *q);
+
+#endif
@@ -0,0 +1,565 @@
+#include "sc_tune.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+// Autotuner. The fastest exact-DP kernel and pipeline, strip count, carve
+// thread count, thumbnail DP width and the image size at which threads
+// start to pay for sharing a seam depend on the machine's caches and cores,
+// so they are measured on synthetic images rather than guessed, together
+// with the per-seam times that carve_seams_budget_ctx plans with.
+//
+// The winners are saved as "key=value" lines to a per-machine profile, by
+// default ~/.cache/seamcarving/profile ($XDG_CACHE_HOME is honoured and
+// $SC_PROFILE overrides the path; SC_PROFILE=none skips the profile). The
+// profile records which machine it was tuned on, and the carving modes
+// tune once on first use when it is missing or belongs to another machine.
+
+#define PROFILE_FORMAT 5
+#define MAX_PATH 1024
+
+// Benchmark sizes: one mid-sized image for the kernels, a few small ones
+// for batch throughput
+#define TUNE_HEIGHT 512
+#define TUNE_WIDTH 768
+#define TUNE_SEAMS 8
+#define TUNE_FAST_SEAMS 32
+#define TUNE_BATCH_IMAGES 8
+#define TUNE_BATCH_HEIGHT 192
+#define TUNE_BATCH_WIDTH 256
+#define TUNE_REPEATS 3
+// Thumbnails for carve_seams_lanes, enough to fill 16-bit lanes twice
+#define TUNE_THUMBS 32
+#define TUNE_THUMB_HEIGHT 64
+#define TUNE_THUMB_WIDTH 96
+// Most threads one exact seam is shared across
+#define TUNE_MAX_DP_THREADS 16
+
+// Band margin the banded time is measured with, as in carve_seams_budget_ctx
+#define TUNE_BAND_MARGIN 16
+
+// SC_PIPELINE_* as the tuner prints them
+static const char *pipeline_names[] = { "off", "rows", "split" };
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+static int num_cpus(void) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    return cpus > 0 ? (int)cpus : 1;
+}
+
+// Helper function to describe the machine a profile is valid for
+static void machine_key(char *key, size_t size) {
+    char model[256] = "unknown";
+    FILE *fp = fopen("/proc/cpuinfo", "r");
+    if (fp) {
+        char line[512];
+        while (fgets(line, sizeof(line), fp)) {
+            char *colon = strchr(line, ':');
+            if (!strncmp(line, "model name", 10) && colon) {
+                snprintf(model, sizeof(model), "%s", colon + 2);
+                model[strcspn(model, "\n")] = '\0';
+                break;
+            }
+        }
+        fclose(fp);
+    }
+#if defined(__AVX2__)
+    const char *isa = "avx2";
+#else
+    const char *isa = "base";
+#endif
+    snprintf(key, size, "%s/%d cpus/%s", model, num_cpus(), isa);
+}
+
+// Where the profile lives, or "" if profiles are turned off
+static void profile_path(char *path) {
+    const char *env = getenv("SC_PROFILE");
+    const char *cache = getenv("XDG_CACHE_HOME");
+    const char *home = getenv("HOME");
+
+    if (env && *env) {
+        snprintf(path, MAX_PATH, "%s", strcmp(env, "none") ? env : "");
+    }
+    else if (cache && *cache) {
+        snprintf(path, MAX_PATH, "%s/seamcarving/profile", cache);
+    }
+    else if (home && *home) {
+        snprintf(path, MAX_PATH, "%s/.cache/seamcarving/profile", home);
+    }
+    else {
+        path[0] = '\0';
+    }
+}
+
+// Helper function to create the directories above path
+static void make_parents(const char *path) {
+    char dir[MAX_PATH];
+    snprintf(dir, sizeof(dir), "%s", path);
+    for (char *p = dir + 1; *p; p++) {
+        if (*p == '/') {
+            *p = '\0';
+            mkdir(dir, 0755);
+            *p = '/';
+        }
+    }
+}
+
+static void default_profile(sc_profile *profile) {
+    sc_get_tuning(&profile->tuning);
+    profile->carve_workers = num_cpus();
+}
+
+// Read the profile at path. Returns 0, or -1 if it is missing, unreadable or
+// was tuned on another machine.
+static int load_profile(const char *path, sc_profile *profile) {
+    FILE *fp = fopen(path, "r");
+    if (!fp) {
+        return -1;
+    }
+
+    char key[512];
+    char line[1024];
+    int format = 0;
+    int same_machine = 0;
+    machine_key(key, sizeof(key));
+    default_profile(profile);
+
+    while (fgets(line, sizeof(line), fp)) {
+        char *eq = strchr(line, '=');
+        if (line[0] == '#' || !eq) {
+            continue;
+        }
+        *eq = '\0';
+        char *value = eq + 1;
+        value[strcspn(value, "\n")] = '\0';
+
+        if (!strcmp(line, "format")) {
+            format = atoi(value);
+        }
+        else if (!strcmp(line, "machine")) {
+            same_machine = !strcmp(value, key);
+        }
+        else if (!strcmp(line, "fused_energy")) {
+            profile->tuning.fused_energy = atoi(value);
+        }
+        else if (!strcmp(line, "strips")) {
+            profile->tuning.strips = atoi(value);
+        }
+        else if (!strcmp(line, "carve_workers")) {
+            profile->carve_workers = atoi(value);
+        }
+        else if (!strcmp(line, "exact_ns")) {
+            profile->tuning.exact_ns = atof(value);
+        }
+        else if (!strcmp(line, "banded_ns")) {
+            profile->tuning.banded_ns = atof(value);
+        }
+        else if (!strcmp(line, "strips_ns")) {
+            profile->tuning.strips_ns = atof(value);
+        }
+        else if (!strcmp(line, "resample_ns")) {
+            profile->tuning.resample_ns = atof(value);
+        }
+        else if (!strcmp(line, "dp_threads")) {
+            profile->tuning.dp_threads = atoi(value);
+        }
+        else if (!strcmp(line, "parallel_pixels")) {
+            profile->tuning.parallel_pixels = atof(value);
+        }
+        else if (!strcmp(line, "pipeline")) {
+            profile->tuning.pipeline = atoi(value);
+        }
+        else if (!strcmp(line, "lanes16")) {
+            profile->tuning.lanes16 = atoi(value);
+        }
+    }
+    fclose(fp);
+
+    if (format != PROFILE_FORMAT || !same_machine || profile->tuning.strips < 1 ||
+        profile->carve_workers < 1 || profile->tuning.exact_ns <= 0 ||
+        profile->tuning.dp_threads < 1 || profile->tuning.pipeline < SC_PIPELINE_OFF ||
+        profile->tuning.pipeline > SC_PIPELINE_SPLIT) {
+        default_profile(profile);
+        return -1;
+    }
+    return 0;
+}
+
+// Write the profile through a temporary file, so a reader never sees half
+static int save_profile(const char *path, sc_profile *profile) {
+    char tmp[MAX_PATH + 8];
+    char key[512];
+    machine_key(key, sizeof(key));
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    make_parents(path);
+
+    FILE *fp = fopen(tmp, "w");
+    if (!fp) {
+        return -1;
+    }
+    fprintf(fp,
+            "# seamcarving autotune profile; rerun `seamcarving tune` to refresh\n"
+            "format=%d\n"
+            "machine=%s\n"
+            "fused_energy=%d\n"
+            "strips=%d\n"
+            "carve_workers=%d\n"
+            "exact_ns=%.3f\n"
+            "banded_ns=%.3f\n"
+            "strips_ns=%.3f\n"
+            "resample_ns=%.3f\n"
+            "dp_threads=%d\n"
+            "parallel_pixels=%.0f\n"
+            "pipeline=%d\n"
+            "lanes16=%d\n",
+            PROFILE_FORMAT, key, profile->tuning.fused_energy, profile->tuning.strips,
+            profile->carve_workers, profile->tuning.exact_ns, profile->tuning.banded_ns,
+            profile->tuning.strips_ns, profile->tuning.resample_ns, profile->tuning.dp_threads,
+            profile->tuning.parallel_pixels, profile->tuning.pipeline, profile->tuning.lanes16);
+    if (fclose(fp) != 0 || rename(tmp, path) != 0) {
+        unlink(tmp);
+        return -1;
+    }
+    return 0;
+}
+
+// Helper function to make a test image with smooth areas, hard edges and
+// noisy texture, so seams behave much as they do on photos
+static uint8_t *synthetic_image(int height, int width, unsigned seed) {
+    uint8_t *img = (uint8_t *)malloc((size_t)height * width * 4);
+    unsigned state = seed;
+
+    for (int j = 0; j < height; j++) {
+        for (int i = 0; i < width; i++) {
+            uint8_t *px = img + 4 * ((size_t)j * width + i);
+            state = state * 1664525u + 1013904223u;
+            int noise = (state >> 24) & 0x3f;
+            int textured = ((i / 64 + j / 48) % 3) == 0;
+            int edge = ((i * 7 + j * 3) / 97) % 2 ? 96 : 0;
+
+            px[0] = (uint8_t)((i * 255 / width + edge + (textured ? noise : 0)) & 0xff);
+            px[1] = (uint8_t)((j * 255 / height + (textured ? noise : 0)) & 0xff);
+            px[2] = (uint8_t)(((i + j) * 127 / (width + height) + edge / 2) & 0xff);
+            px[3] = 255;
+        }
+    }
+    return img;
+}
+
+// Best time of TUNE_REPEATS carves, after one that warms the context
+static double time_carve(sc_context *ctx, uint8_t *img, int height, int width, int num_seams,
+                         int band_margin, int strips) {
+    double best = 0;
+    for (int r = 0; r <= TUNE_REPEATS; r++) {
+        double start = now_ms();
+        uint8_t *out = carve_seams_strips_ctx(ctx, img, height, width, num_seams, strips,
+                                              band_margin, 0);
+        double ms = now_ms() - start;
+        free(out);
+        if (r > 0 && (best == 0 || ms < best)) {
+            best = ms;
+        }
+    }
+    return best;
+}
+
+typedef struct {
+    uint8_t **images;
+    int first;
+    int step;
+} batch_share;
+
+static void *carve_share(void *arg) {
+    batch_share *share = (batch_share *)arg;
+    sc_context *ctx = sc_context_create();
+    for (int k = share->first; k < TUNE_BATCH_IMAGES; k += share->step) {
+        free(carve_seams_ctx(ctx, share->images[k], TUNE_BATCH_HEIGHT, TUNE_BATCH_WIDTH,
+                             TUNE_SEAMS * 2, 0, 0));
+    }
+    sc_context_destroy(ctx);
+    return NULL;
+}
+
+// Time carving TUNE_BATCH_IMAGES small images on `threads` threads
+static double time_batch(uint8_t **images, int threads) {
+    pthread_t *ids = (pthread_t *)malloc(threads * sizeof(pthread_t));
+    batch_share *shares = (batch_share *)malloc(threads * sizeof(batch_share));
+    double best = 0;
+
+    for (int r = 0; r < TUNE_REPEATS; r++) {
+        double start = now_ms();
+        for (int t = 0; t < threads; t++) {
+            shares[t].images = images;
+            shares[t].first = t;
+            shares[t].step = threads;
+            pthread_create(&ids[t], NULL, carve_share, &shares[t]);
+        }
+        for (int t = 0; t < threads; t++) {
+            pthread_join(ids[t], NULL);
+        }
+        double ms = now_ms() - start;
+        if (best == 0 || ms < best) {
+            best = ms;
+        }
+    }
+
+    free(ids);
+    free(shares);
+    return best;
+}
+
+// Best time of TUNE_REPEATS thumbnail batches through carve_seams_lanes
+static double time_lanes(sc_context *ctx, uint8_t **thumbs) {
+    uint8_t *out[TUNE_THUMBS];
+    double best = 0;
+    for (int r = 0; r <= TUNE_REPEATS; r++) {
+        double start = now_ms();
+        carve_seams_lanes_ctx(ctx, thumbs, out, TUNE_THUMBS, TUNE_THUMB_HEIGHT, TUNE_THUMB_WIDTH,
+                              TUNE_SEAMS * 2);
+        double ms = now_ms() - start;
+        for (int k = 0; k < TUNE_THUMBS; k++) {
+            free(out[k]);
+        }
+        if (r > 0 && (best == 0 || ms < best)) {
+            best = ms;
+        }
+    }
+    return best;
+}
+
+// Benchmark every candidate and fill in profile. With verbose, print the
+// times as it goes.
+static void autotune(sc_profile *profile, int verbose) {
+    int height = TUNE_HEIGHT;
+    int width = TUNE_WIDTH;
+    double per_seam_pixel = 1e6 / ((double)TUNE_SEAMS * height * width);
+    uint8_t *img = synthetic_image(height, width, 1);
+    sc_context *ctx = sc_context_create();
+    sc_tuning tuning;
+
+    default_profile(profile);
+    tuning = profile->tuning;
+    tuning.dp_threads = 1;
+
+    // Exact DP kernel: separate energy pass or energy fused into the DP, for
+    // the exact seams that are not pipelined
+    double kernel_ms[2];
+    tuning.pipeline = SC_PIPELINE_OFF;
+    for (int fused = 0; fused < 2; fused++) {
+        tuning.fused_energy = fused;
+        sc_set_tuning(&tuning);
+        kernel_ms[fused] = time_carve(ctx, img, height, width, TUNE_SEAMS, 0, 1);
+        if (verbose) {
+            fprintf(stderr, "tune: exact kernel %-8s %7.2f ms\n", fused ? "fused" : "two-pass",
+                    kernel_ms[fused]);
+        }
+    }
+    tuning.fused_energy = kernel_ms[1] < kernel_ms[0];
+
+    // Pipelined exact seams, and with more than one core the pipeline with
+    // seam removal on a second thread
+    double exact_ms = kernel_ms[tuning.fused_energy];
+    int max_pipeline = (num_cpus() > 1) ? SC_PIPELINE_SPLIT : SC_PIPELINE_ROWS;
+    int best_pipeline = SC_PIPELINE_OFF;
+    for (int pipeline = SC_PIPELINE_ROWS; pipeline <= max_pipeline; pipeline++) {
+        tuning.pipeline = pipeline;
+        sc_set_tuning(&tuning);
+        double ms = time_carve(ctx, img, height, width, TUNE_SEAMS, 0, 1);
+        if (verbose) {
+            fprintf(stderr, "tune: pipeline %-12s %7.2f ms\n", pipeline_names[pipeline], ms);
+        }
+        if (ms < exact_ms) {
+            exact_ms = ms;
+            best_pipeline = pipeline;
+        }
+    }
+    tuning.pipeline = best_pipeline;
+    tuning.exact_ns = exact_ms * per_seam_pixel;
+    sc_set_tuning(&tuning);
+
+    // Banded and strip seams are timed without the full DP that starts a
+    // band (once per carve, or once per round of strips), which sc_plan_carve
+    // counts separately
+    double full_dp_ms = kernel_ms[tuning.fused_energy] / TUNE_SEAMS;
+    double fast_seam_rows = (double)TUNE_FAST_SEAMS * height / 1e6;
+    double banded_ms = time_carve(ctx, img, height, width, TUNE_FAST_SEAMS, TUNE_BAND_MARGIN, 1);
+    tuning.banded_ns = fmax(banded_ms - full_dp_ms, banded_ms / 4) / fast_seam_rows;
+
+    // Strips: powers of two up to the core count, but at least up to 4 since
+    // narrower strips are cheaper per seam even on one core
+    int max_strips = num_cpus() > 4 ? num_cpus() : 4;
+    double best_strips_ms = 0;
+    for (int strips = 2; strips <= max_strips && strips <= 16; strips *= 2) {
+        double ms = time_carve(ctx, img, height, width, TUNE_FAST_SEAMS, TUNE_BAND_MARGIN, strips);
+        if (verbose) {
+            fprintf(stderr, "tune: %2d strips %15.2f ms\n", strips, ms);
+        }
+        if (best_strips_ms == 0 || ms < best_strips_ms) {
+            best_strips_ms = ms;
+            tuning.strips = strips;
+        }
+    }
+    tuning.strips_ns = fmax(best_strips_ms - full_dp_ms, best_strips_ms / 4) / fast_seam_rows;
+
+    // Resampling, timed through a budget carve with no time at all
+    sc_budget_report report;
+    double resample_ms = 0;
+    for (int r = 0; r <= TUNE_REPEATS; r++) {
+        free(carve_seams_budget_ctx(ctx, img, height, width, width / 4, 0, &report));
+        if (r > 0 && (resample_ms == 0 || report.ms < resample_ms)) {
+            resample_ms = report.ms;
+        }
+    }
+    tuning.resample_ns = resample_ms * 1e6 / ((double)height * width);
+
+    // Carve threads for batches; more only if clearly faster
+    uint8_t *images[TUNE_BATCH_IMAGES];
+    for (int k = 0; k < TUNE_BATCH_IMAGES; k++) {
+        images[k] = synthetic_image(TUNE_BATCH_HEIGHT, TUNE_BATCH_WIDTH, k + 2);
+    }
+    int candidates[8];
+    int num_candidates = 0;
+    for (int threads = 1; threads < num_cpus() && num_candidates < 7; threads *= 2) {
+        candidates[num_candidates++] = threads;
+    }
+    candidates[num_candidates++] = num_cpus();
+
+    double best_batch_ms = 0;
+    for (int c = 0; c < num_candidates; c++) {
+        double ms = time_batch(images, candidates[c]);
+        if (verbose) {
+            fprintf(stderr, "tune: %2d carve threads %8.2f ms\n", candidates[c], ms);
+        }
+        if (best_batch_ms == 0 || ms < best_batch_ms * 0.95) {
+            best_batch_ms = ms;
+            profile->carve_workers = candidates[c];
+        }
+    }
+    for (int k = 0; k < TUNE_BATCH_IMAGES; k++) {
+        free(images[k]);
+    }
+
+    // Thumbnail batches: 32-bit lanes, or pairs of lane groups in a 16-bit DP
+    uint8_t *thumbs[TUNE_THUMBS];
+    for (int k = 0; k < TUNE_THUMBS; k++) {
+        thumbs[k] = synthetic_image(TUNE_THUMB_HEIGHT, TUNE_THUMB_WIDTH, k + 40);
+    }
+    double lanes_ms[2];
+    for (int lanes16 = 0; lanes16 < 2; lanes16++) {
+        tuning.lanes16 = lanes16;
+        sc_set_tuning(&tuning);
+        lanes_ms[lanes16] = time_lanes(ctx, thumbs);
+        if (verbose) {
+            fprintf(stderr, "tune: %d-bit lane DP %10.2f ms\n", lanes16 ? 16 : 32,
+                    lanes_ms[lanes16]);
+        }
+    }
+    tuning.lanes16 = lanes_ms[1] < lanes_ms[0];
+    for (int k = 0; k < TUNE_THUMBS; k++) {
+        free(thumbs[k]);
+    }
+
+    // Threads sharing each exact seam: from the smallest image, about 0.25
+    // to 2 megapixels, on which they beat one thread by 10%, or none
+    tuning.parallel_pixels = 0;
+    if (num_cpus() > 1) {
+        int threads = num_cpus() < TUNE_MAX_DP_THREADS ? num_cpus() : TUNE_MAX_DP_THREADS;
+        static const int sizes[][2] = { { 384, 640 }, { 512, 1024 }, { 768, 1366 }, { 1024, 2048 } };
+        for (int k = 0; k < 4 && tuning.parallel_pixels == 0; k++) {
+            int h = sizes[k][0];
+            int w = sizes[k][1];
+            uint8_t *big = synthetic_image(h, w, k + 20);
+            double ms[2];
+            for (int parallel = 0; parallel < 2; parallel++) {
+                tuning.dp_threads = parallel ? threads : 1;
+                tuning.parallel_pixels = parallel ? 1 : 0;
+                sc_set_tuning(&tuning);
+                ms[parallel] = time_carve(ctx, big, h, w, TUNE_SEAMS, 0, 1);
+            }
+            if (verbose) {
+                fprintf(stderr, "tune: %4dx%-4d exact 1 thread %7.2f ms, %2d threads %7.2f ms\n",
+                        w, h, ms[0], threads, ms[1]);
+            }
+            tuning.parallel_pixels = (ms[1] < ms[0] * 0.9) ? (double)h * w / threads : 0;
+            free(big);
+        }
+        tuning.dp_threads = (tuning.parallel_pixels > 0) ? threads : 1;
+    }
+
+    profile->tuning = tuning;
+    sc_set_tuning(&tuning);
+    sc_context_destroy(ctx);
+    free(img);
+}
+
+int sc_use_profile(sc_profile *profile) {
+    char path[MAX_PATH];
+    profile_path(path);
+
+    if (!path[0]) {
+        default_profile(profile);
+        return 0;
+    }
+    if (load_profile(path, profile) == 0) {
+        sc_set_tuning(&profile->tuning);
+        return 0;
+    }
+
+    fprintf(stderr, "seamcarving: tuning for this machine (once)...\n");
+    autotune(profile, 0);
+    if (save_profile(path, profile) != 0) {
+        fprintf(stderr, "seamcarving: cannot save the profile to %s\n", path);
+        return -1;
+    }
+    fprintf(stderr, "seamcarving: profile saved to %s\n", path);
+    return 0;
+}
+
+int run_tune(int argc, char **argv) {
+    char path[MAX_PATH];
+    sc_profile profile;
+    profile_path(path);
+
+    for (int a = 0; a < argc; a++) {
+        if (!strcmp(argv[a], "--profile") && a + 1 < argc) {
+            snprintf(path, sizeof(path), "%s", argv[++a]);
+        }
+        else {
+            fprintf(stderr, "tune: unknown option %s\n", argv[a]);
+            return 2;
+        }
+    }
+
+    double start = now_ms();
+    autotune(&profile, 1);
+    fprintf(stderr,
+            "tune: %s exact kernel, pipeline %s, %d-bit lane DP, %d strips, %d carve workers, "
+            "%d DP threads from %.0f pixels each; per seam: exact %.2f ns a pixel, banded %.0f "
+            "ns and strips %.0f ns a row (%.0f ms)\n",
+            profile.tuning.fused_energy ? "fused" : "two-pass",
+            pipeline_names[profile.tuning.pipeline], profile.tuning.lanes16 ? 16 : 32,
+            profile.tuning.strips,
+            profile.carve_workers, profile.tuning.dp_threads, profile.tuning.parallel_pixels,
+            profile.tuning.exact_ns, profile.tuning.banded_ns, profile.tuning.strips_ns,
+            now_ms() - start);
+
+    if (!path[0]) {
+        return 0;
+    }
+    if (save_profile(path, &profile) != 0) {
+        fprintf(stderr, "tune: cannot write %s\n", path);
+        return 1;
+    }
+    fprintf(stderr, "tune: saved %s\n", path);
+    return 0;
+}
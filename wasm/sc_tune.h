@@ -0,0 +1,20 @@
+#if !defined(SC_TUNE_H)
+#define SC_TUNE_H
+
+#include "seamcarving_wasm.h"
+
+// What the autotuner chose for this machine
+typedef struct {
+    sc_tuning tuning;
+    int carve_workers;    // carve threads with the best batch throughput
+} sc_profile;
+
+// Benchmark and save a new profile: `seamcarving tune`
+int run_tune(int argc, char **argv);
+
+// Load this machine's profile into profile and the engine, tuning and saving
+// one first if there is none yet. Returns 0, or -1 if it could not be saved
+// (the profile is still used for this run).
+int sc_use_profile(sc_profile *profile);
+
+#endif
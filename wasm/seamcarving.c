@@ -90,6 +90,61 @@ void calc_energy(struct rgb_img *im, struct rgb_img **grad)
     }
 }
 
+// Part 1b: The same energy for an image kept as gap buffers. Each row is
+// copied out of its gap buffer once, into a window of three rows.
+// Returns 0, or -1 with *grad set to NULL if memory runs out.
+int calc_energy_gap(struct gap_img *im, struct rgb_img **grad)
+{
+    int w = im->width;
+    int h = im->height;
+    if(create_img(grad, h, w) != 0){
+        return -1;
+    }
+
+    uint8_t *rows = (uint8_t *)malloc(9 * (size_t)w);
+    if(rows == NULL){
+        destroy_image(*grad);
+        *grad = NULL;
+        return -1;
+    }
+    uint8_t *up = rows;
+    uint8_t *cur = rows + 3 * w;
+    uint8_t *down = rows + 6 * w;
+    gap_copy_row(im, h - 1, up);
+    gap_copy_row(im, 0, cur);
+
+    for(int j = 0; j < h; j++){
+        gap_copy_row(im, (j == h - 1) ? 0 : j + 1, down);
+
+        for(int i = 0; i < w; i++){
+            int k_left = (i == 0) ? w - 1 : i - 1;
+            int k_right = (i == w - 1) ? 0 : i + 1;
+
+            int R_x = cur[3 * k_right + 0] - cur[3 * k_left + 0];
+            int G_x = cur[3 * k_right + 1] - cur[3 * k_left + 1];
+            int B_x = cur[3 * k_right + 2] - cur[3 * k_left + 2];
+
+            int R_y = up[3 * i + 0] - down[3 * i + 0];
+            int G_y = up[3 * i + 1] - down[3 * i + 1];
+            int B_y = up[3 * i + 2] - down[3 * i + 2];
+
+            int grad_x_2 = R_x*R_x + B_x*B_x + G_x*G_x;
+            int grad_y_2 = R_y*R_y + B_y*B_y + G_y*G_y;
+            int energy = sqrt(grad_x_2 + grad_y_2);
+            uint8_t energy_norm = (uint8_t)(energy / 10);
+            set_pixel(*grad, j, i, energy_norm, energy_norm, energy_norm);
+        }
+
+        // Slide the window down a row
+        uint8_t *tmp = up;
+        up = cur;
+        cur = down;
+        down = tmp;
+    }
+    free(rows);
+    return 0;
+}
+
 // Part 2: Cost Array
 // Helper functions to compare the previous energies
 double min_2(double e1, double e2){
@@ -113,10 +168,14 @@ double min_3(double e1, double e2, double e3){
 
 }
 
-void dynamic_seam(struct rgb_img *grad, double **best_arr)
+// Returns 0, or -1 with *best_arr set to NULL if memory runs out
+int dynamic_seam(struct rgb_img *grad, double **best_arr)
 {
     // 1. Set up the array
     (*best_arr) = (double *)malloc(grad->height * grad->width * sizeof(double));
+    if(*best_arr == NULL){
+        return -1;
+    }
 
     // 2. Set up the base case since the energy for the top row will be the same as in grad.
     for(int i = 0; i < grad->width; i++){
@@ -166,13 +225,18 @@ void dynamic_seam(struct rgb_img *grad, double **best_arr)
             (*best_arr)[j * grad->width + i] = cur + min; 
         }
     }
+    return 0;
 }
 
 // Part 3: Recover the seam
-void recover_path(double *best, int height, int width, int **path)
+// Returns 0, or -1 with *path set to NULL if memory runs out
+int recover_path(double *best, int height, int width, int **path)
 {
     // 1. Mallocing space for the path array. 
     (*path) = (int *)malloc(sizeof(int) * height);
+    if(*path == NULL){
+        return -1;
+    }
 
     // 1.1 Inititate a variable that will have the column index of the current node (i.e. energy sum)
     int x_cont; 
@@ -282,6 +346,7 @@ void recover_path(double *best, int height, int width, int **path)
             }
         }
     }
+    return 0;
 }
 
 // Part 4: Write a function that removes the seam 
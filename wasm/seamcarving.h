@@ -3,8 +3,9 @@
 #include "c_img.h"
 
 void calc_energy(struct rgb_img *im, struct rgb_img **grad);
-void dynamic_seam(struct rgb_img *grad, double **best_arr);
-void recover_path(double *best, int height, int width, int **path);
+int calc_energy_gap(struct gap_img *im, struct rgb_img **grad);
+int dynamic_seam(struct rgb_img *grad, double **best_arr);
+int recover_path(double *best, int height, int width, int **path);
 void remove_seam(struct rgb_img *src, struct rgb_img **dest, int *path);
 
 #endif 
\ No newline at end of file
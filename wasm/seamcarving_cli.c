@@ -0,0 +1,732 @@
+#include "seamcarving_wasm.h"
+#include "ppm.h"
+#include "sc_queue.h"
+#include "sc_daemon.h"
+#include "sc_checkpoint.h"
+#include "sc_tune.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <stdatomic.h>
+
+// Items buffered between two pipeline stages
+#define QUEUE_CAPACITY 4
+
+typedef struct {
+    uint8_t *pixels;
+    int height;
+    int width;
+} frame;
+
+static void free_frame(frame *f) {
+    free(f->pixels);
+    free(f);
+}
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+// Part 1: Video mode
+typedef struct {
+    int num_seams;      // seams to remove, or -1 to derive from target_width
+    int target_width;
+    int band_margin;
+    sc_queue decoded;
+    sc_queue carved;
+    atomic_int failed;
+    int frames;
+    long seams_reused;
+    long seams_banded;
+    long seams_exact;
+    double carve_ms;
+} video_job;
+
+static void *video_decode(void *arg) {
+    video_job *job = (video_job *)arg;
+    for (;;) {
+        frame *f = (frame *)malloc(sizeof(frame));
+        int status = ppm_read(stdin, &f->pixels, &f->height, &f->width);
+        if (status <= 0) {
+            if (status < 0) {
+                fprintf(stderr, "video: malformed PPM frame on stdin\n");
+                atomic_store(&job->failed, 1);
+            }
+            free(f);
+            break;
+        }
+        sc_queue_push(&job->decoded, f);
+    }
+    sc_queue_producer_done(&job->decoded);
+    return NULL;
+}
+
+static void *video_carve(void *arg) {
+    video_job *job = (video_job *)arg;
+    video_state *vs = NULL;
+    frame *f;
+
+    while ((f = sc_queue_pop(&job->decoded)) != NULL) {
+        if (!vs && !atomic_load(&job->failed)) {
+            int num_seams = job->num_seams >= 0 ? job->num_seams : f->width - job->target_width;
+            vs = video_create(f->height, f->width, num_seams, job->band_margin);
+            if (!vs) {
+                fprintf(stderr, "video: cannot remove %d seams from a %dpx wide frame\n",
+                        num_seams, f->width);
+                atomic_store(&job->failed, 1);
+            }
+        }
+        if (atomic_load(&job->failed) || f->height != vs->height || f->width != vs->width) {
+            if (!atomic_load(&job->failed)) {
+                fprintf(stderr, "video: frame %d is %dx%d, expected %dx%d\n", job->frames,
+                        f->width, f->height, vs->width, vs->height);
+                atomic_store(&job->failed, 1);
+            }
+            // Keep draining so the decoder never blocks on a full queue
+            free_frame(f);
+            continue;
+        }
+
+        double start = now_ms();
+        frame *out = (frame *)malloc(sizeof(frame));
+        out->pixels = video_carve_frame(vs, f->pixels);
+        out->height = f->height;
+        out->width = f->width - vs->num_seams;
+        job->carve_ms += now_ms() - start;
+
+        job->frames++;
+        job->seams_reused += vs->seams_reused;
+        job->seams_banded += vs->seams_banded;
+        job->seams_exact += vs->seams_exact;
+
+        free_frame(f);
+        sc_queue_push(&job->carved, out);
+    }
+
+    if (vs) {
+        video_destroy(vs);
+    }
+    sc_queue_producer_done(&job->carved);
+    return NULL;
+}
+
+static void *video_encode(void *arg) {
+    video_job *job = (video_job *)arg;
+    frame *f;
+
+    while ((f = sc_queue_pop(&job->carved)) != NULL) {
+        if (ppm_write(stdout, f->pixels, f->height, f->width) != 0) {
+            atomic_store(&job->failed, 1);
+        }
+        fflush(stdout);
+        free_frame(f);
+    }
+    return NULL;
+}
+
+// Carve a PPM frame sequence from stdin to stdout. Decode, carve and encode
+// run on their own threads so I/O overlaps with carving.
+static int run_video(int argc, char **argv) {
+    sc_profile profile;
+    sc_use_profile(&profile);
+    video_job job;
+    memset(&job, 0, sizeof(job));
+    job.num_seams = -1;
+    job.target_width = -1;
+    job.band_margin = 8;
+
+    for (int a = 0; a < argc; a++) {
+        if (!strcmp(argv[a], "--seams") && a + 1 < argc) {
+            job.num_seams = atoi(argv[++a]);
+        }
+        else if (!strcmp(argv[a], "--width") && a + 1 < argc) {
+            job.target_width = atoi(argv[++a]);
+        }
+        else if (!strcmp(argv[a], "--band") && a + 1 < argc) {
+            job.band_margin = atoi(argv[++a]);
+        }
+        else {
+            fprintf(stderr, "video: unknown option %s\n", argv[a]);
+            return 2;
+        }
+    }
+    if (job.num_seams < 0 && job.target_width < 0) {
+        fprintf(stderr, "video: one of --seams or --width is required\n");
+        return 2;
+    }
+
+    sc_queue_init(&job.decoded, QUEUE_CAPACITY, 1);
+    sc_queue_init(&job.carved, QUEUE_CAPACITY, 1);
+
+    pthread_t decoder, carver, encoder;
+    double start = now_ms();
+    pthread_create(&decoder, NULL, video_decode, &job);
+    pthread_create(&carver, NULL, video_carve, &job);
+    pthread_create(&encoder, NULL, video_encode, &job);
+    pthread_join(decoder, NULL);
+    pthread_join(carver, NULL);
+    pthread_join(encoder, NULL);
+    double total_ms = now_ms() - start;
+    sc_queue_destroy(&job.decoded);
+    sc_queue_destroy(&job.carved);
+
+    fprintf(stderr, "video: %d frames in %.1f ms (carve %.2f ms/frame)\n", job.frames,
+            total_ms, job.frames ? job.carve_ms / job.frames : 0.0);
+    fprintf(stderr, "video: seams reused %ld, banded %ld, exact %ld\n",
+            job.seams_reused, job.seams_banded, job.seams_exact);
+
+    return atomic_load(&job.failed) ? 1 : 0;
+}
+
+// Part 2: Batch mode
+enum { STAGE_READ, STAGE_DECODE, STAGE_CARVE, STAGE_ENCODE, STAGE_WRITE, NUM_STAGES };
+
+static const char *stage_names[NUM_STAGES] = { "read", "decode", "carve", "encode", "write" };
+
+static const char *plan_names[SC_NUM_PLANS] = { "exact", "banded", "strips" };
+
+// --plan levels, indexed by SC_QUALITY_*
+static const char *quality_names[SC_NUM_PLANS] = { "exact", "high", "fast" };
+
+static const char *table_names[SC_NUM_TABLES] = { "full", "bitmap", "linear", "band" };
+
+typedef struct {
+    char *input;
+    char *output;
+    int target_width;   // -1 to use the batch-wide setting
+    uint8_t *data;      // encoded file contents
+    size_t size;
+    uint8_t *pixels;    // decoded RGBA raster
+    int height;
+    int width;
+} batch_item;
+
+typedef struct {
+    batch_item **items;
+    int count;
+    atomic_int next_item;
+    int num_seams;
+    int target_width;
+    int band_margin;
+    int strips;
+    int quality;        // SC_QUALITY_* to plan every carve, or -1 to use band_margin and strips
+    size_t memory_limit;
+    int workers[NUM_STAGES];
+    int queue_capacity;
+    sc_queue queues[NUM_STAGES];   // queues[k] feeds stage k; the read stage has none
+    atomic_long processed[NUM_STAGES];
+    atomic_long busy_us[NUM_STAGES];
+    atomic_int failed;
+    atomic_long planned[SC_NUM_PLANS];
+    atomic_long plan_error_sum;      // |actual - predicted| / predicted, in 1/10000
+} batch_job;
+
+typedef struct {
+    batch_job *job;
+    int stage;
+    sc_context *ctx;    // carve workers reuse their working set across images
+} stage_worker;
+
+static void free_item(batch_item *item) {
+    free(item->input);
+    free(item->output);
+    free(item->data);
+    free(item->pixels);
+    free(item);
+}
+
+static int read_file(char *filename, uint8_t **data, size_t *size) {
+    FILE *fp = fopen(filename, "rb");
+    if (!fp) {
+        return 0;
+    }
+    fseek(fp, 0, SEEK_END);
+    long length = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    if (length <= 0) {
+        fclose(fp);
+        return 0;
+    }
+
+    *data = (uint8_t *)malloc(length);
+    *size = fread(*data, 1, length, fp);
+    fclose(fp);
+    return *size == (size_t)length;
+}
+
+// Log a planned carve next to its prediction
+static void report_plan(batch_job *job, batch_item *item, sc_plan *plan, int fits, double ms) {
+    double predicted = plan->predicted_ms[plan->mode];
+    double error = predicted > 0 ? (ms - predicted) / predicted : 0;
+
+    fprintf(stderr,
+            "plan: %s: %s%s (flat %.0f%%; exact %.1f, banded %.1f, strips %.1f ms), "
+            "predicted %.1f ms, took %.1f ms (%+.0f%%)\n",
+            item->input, plan_names[plan->mode], fits ? "" : " with smaller DP tables",
+            plan->flat_fraction * 100, plan->predicted_ms[SC_PLAN_EXACT],
+            plan->predicted_ms[SC_PLAN_BANDED], plan->predicted_ms[SC_PLAN_STRIPS], predicted, ms,
+            error * 100);
+    atomic_fetch_add(&job->planned[plan->mode], 1);
+    atomic_fetch_add(&job->plan_error_sum, (long)(fabs(error) * 10000));
+}
+
+// Run one stage on one item. Returns 1 on success.
+static int batch_process(stage_worker *worker, batch_item *item) {
+    batch_job *job = worker->job;
+
+    switch (worker->stage) {
+    case STAGE_READ:
+        return read_file(item->input, &item->data, &item->size);
+
+    case STAGE_DECODE: {
+        int status = ppm_decode(item->data, item->size, &item->pixels, &item->height, &item->width);
+        free(item->data);
+        item->data = NULL;
+        if (status != 1) {
+            item->pixels = NULL;
+        }
+        return status == 1;
+    }
+
+    case STAGE_CARVE: {
+        int target = item->target_width >= 0 ? item->target_width : job->target_width;
+        int num_seams = job->num_seams >= 0 ? job->num_seams : item->width - target;
+        int strips = job->strips;
+        int band_margin = job->band_margin;
+        sc_plan plan;
+        int fits = 1;
+        if (job->quality >= 0 && num_seams >= 0 && num_seams < item->width) {
+            fits = sc_plan_carve(item->pixels, item->height, item->width, num_seams,
+                                 job->quality, job->memory_limit, &plan) == 0;
+            strips = plan.strips;
+            band_margin = plan.band_margin;
+        }
+
+        double start = now_ms();
+        uint8_t *carved = carve_seams_strips_ctx(worker->ctx, item->pixels, item->height,
+                                                 item->width, num_seams, strips, band_margin, 0);
+        if (!carved) {
+            return 0;
+        }
+        if (job->quality >= 0) {
+            report_plan(job, item, &plan, fits, now_ms() - start);
+        }
+        free(item->pixels);
+        item->pixels = carved;
+        item->width -= num_seams;
+        return 1;
+    }
+
+    case STAGE_ENCODE: {
+        int status = ppm_encode(item->pixels, item->height, item->width, &item->data, &item->size);
+        free(item->pixels);
+        item->pixels = NULL;
+        return status == 0;
+    }
+
+    case STAGE_WRITE: {
+        FILE *fp = fopen(item->output, "wb");
+        if (!fp) {
+            return 0;
+        }
+        size_t written = fwrite(item->data, 1, item->size, fp);
+        return (fclose(fp) == 0) && written == item->size;
+    }
+    }
+    return 0;
+}
+
+static void *batch_stage(void *arg) {
+    stage_worker *worker = (stage_worker *)arg;
+    batch_job *job = worker->job;
+    int stage = worker->stage;
+
+    for (;;) {
+        batch_item *item;
+        if (stage == STAGE_READ) {
+            int next = atomic_fetch_add(&job->next_item, 1);
+            if (next >= job->count) {
+                break;
+            }
+            item = job->items[next];
+        }
+        else if ((item = (batch_item *)sc_queue_pop(&job->queues[stage])) == NULL) {
+            break;
+        }
+
+        double start = now_ms();
+        int ok = batch_process(worker, item);
+        atomic_fetch_add(&job->busy_us[stage], (long)((now_ms() - start) * 1000));
+        atomic_fetch_add(&job->processed[stage], 1);
+
+        if (!ok) {
+            fprintf(stderr, "batch: %s failed in the %s stage\n", item->input, stage_names[stage]);
+            atomic_store(&job->failed, 1);
+            free_item(item);
+        }
+        else if (stage + 1 < NUM_STAGES) {
+            // Blocks while the next stage is behind, which bounds the images in flight
+            sc_queue_push(&job->queues[stage + 1], item);
+        }
+        else {
+            free_item(item);
+        }
+    }
+
+    if (stage + 1 < NUM_STAGES) {
+        sc_queue_producer_done(&job->queues[stage + 1]);
+    }
+    return NULL;
+}
+
+// Parse "in out [width]" lines; blank lines and # comments are skipped
+static int read_job_list(char *filename, batch_job *job) {
+    FILE *fp = fopen(filename, "r");
+    if (!fp) {
+        fprintf(stderr, "batch: cannot open job list %s\n", filename);
+        return 0;
+    }
+
+    char line[2 * 4096 + 64];
+    char input[4096];
+    char output[4096];
+    int capacity = 16;
+    job->items = (batch_item **)malloc(capacity * sizeof(batch_item *));
+
+    while (fgets(line, sizeof(line), fp)) {
+        int target_width = -1;
+        int fields = sscanf(line, "%4095s %4095s %d", input, output, &target_width);
+        if (fields <= 0 || input[0] == '#') {
+            continue;
+        }
+        if (fields < 2) {
+            fprintf(stderr, "batch: expected \"input output [width]\": %s", line);
+            fclose(fp);
+            return 0;
+        }
+
+        if (job->count == capacity) {
+            capacity *= 2;
+            job->items = (batch_item **)realloc(job->items, capacity * sizeof(batch_item *));
+        }
+        batch_item *item = (batch_item *)calloc(1, sizeof(batch_item));
+        item->input = strdup(input);
+        item->output = strdup(output);
+        item->target_width = target_width;
+        job->items[job->count++] = item;
+    }
+
+    fclose(fp);
+    return 1;
+}
+
+// Parse "read=1,carve=4,..." into per-stage worker counts
+static int parse_workers(char *spec, int *workers) {
+    char *copy = strdup(spec);
+    char *save = NULL;
+    int ok = 1;
+
+    for (char *part = strtok_r(copy, ",", &save); part; part = strtok_r(NULL, ",", &save)) {
+        char *eq = strchr(part, '=');
+        int matched = 0;
+        if (eq) {
+            *eq = '\0';
+            for (int k = 0; k < NUM_STAGES; k++) {
+                if (!strcmp(part, stage_names[k]) && atoi(eq + 1) > 0) {
+                    workers[k] = atoi(eq + 1);
+                    matched = 1;
+                }
+            }
+        }
+        if (!matched) {
+            fprintf(stderr, "batch: bad --workers entry %s\n", part);
+            ok = 0;
+        }
+    }
+
+    free(copy);
+    return ok;
+}
+
+// Carve every image of a job list through a read -> decode -> carve ->
+// encode -> write pipeline. Each stage has its own worker threads and the
+// stages are joined by bounded lock-free queues, so throughput approaches the
+// slowest stage while memory stays bounded by the queue capacity.
+static int run_batch(int argc, char **argv) {
+    batch_job job;
+    memset(&job, 0, sizeof(job));
+    job.num_seams = -1;
+    job.target_width = -1;
+    job.strips = 1;
+    job.quality = -1;
+    job.queue_capacity = QUEUE_CAPACITY;
+    for (int k = 0; k < NUM_STAGES; k++) {
+        job.workers[k] = 1;
+    }
+    sc_profile profile;
+    sc_use_profile(&profile);
+    job.workers[STAGE_CARVE] = profile.carve_workers;
+
+    char *job_list = NULL;
+    for (int a = 0; a < argc; a++) {
+        if (!strcmp(argv[a], "--seams") && a + 1 < argc) {
+            job.num_seams = atoi(argv[++a]);
+        }
+        else if (!strcmp(argv[a], "--width") && a + 1 < argc) {
+            job.target_width = atoi(argv[++a]);
+        }
+        else if (!strcmp(argv[a], "--band") && a + 1 < argc) {
+            job.band_margin = atoi(argv[++a]);
+        }
+        else if (!strcmp(argv[a], "--strips") && a + 1 < argc) {
+            job.strips = atoi(argv[++a]);
+        }
+        else if (!strcmp(argv[a], "--plan") && a + 1 < argc) {
+            a++;
+            for (int q = 0; q < SC_NUM_PLANS; q++) {
+                if (!strcmp(argv[a], quality_names[q])) {
+                    job.quality = q;
+                }
+            }
+            if (job.quality < 0) {
+                fprintf(stderr, "batch: --plan takes exact, high or fast\n");
+                return 2;
+            }
+        }
+        else if (!strcmp(argv[a], "--memory") && a + 1 < argc) {
+            job.memory_limit = (size_t)atoi(argv[++a]) << 20;
+        }
+        else if (!strcmp(argv[a], "--queue") && a + 1 < argc) {
+            job.queue_capacity = atoi(argv[++a]);
+        }
+        else if (!strcmp(argv[a], "--workers") && a + 1 < argc) {
+            if (!parse_workers(argv[++a], job.workers)) {
+                return 2;
+            }
+        }
+        else if (argv[a][0] != '-' && !job_list) {
+            job_list = argv[a];
+        }
+        else {
+            fprintf(stderr, "batch: unknown option %s\n", argv[a]);
+            return 2;
+        }
+    }
+    if (!job_list || !read_job_list(job_list, &job)) {
+        fprintf(stderr, "batch: a job list is required\n");
+        return 2;
+    }
+
+    int any_width = job.target_width >= 0;
+    for (int n = 0; n < job.count; n++) {
+        any_width = any_width || job.items[n]->target_width >= 0;
+    }
+    if (job.num_seams < 0 && !any_width) {
+        fprintf(stderr, "batch: one of --seams or --width is required\n");
+        return 2;
+    }
+
+    for (int k = 1; k < NUM_STAGES; k++) {
+        sc_queue_init(&job.queues[k], job.queue_capacity, job.workers[k - 1]);
+    }
+
+    int total_workers = 0;
+    for (int k = 0; k < NUM_STAGES; k++) {
+        total_workers += job.workers[k];
+    }
+    pthread_t *threads = (pthread_t *)malloc(total_workers * sizeof(pthread_t));
+    stage_worker *workers = (stage_worker *)malloc(total_workers * sizeof(stage_worker));
+
+    double start = now_ms();
+    int t = 0;
+    for (int k = 0; k < NUM_STAGES; k++) {
+        for (int n = 0; n < job.workers[k]; n++, t++) {
+            workers[t].job = &job;
+            workers[t].stage = k;
+            workers[t].ctx = (k == STAGE_CARVE) ? sc_context_create() : NULL;
+            if (workers[t].ctx) {
+                workers[t].ctx->memory_limit = job.memory_limit;
+            }
+            pthread_create(&threads[t], NULL, batch_stage, &workers[t]);
+        }
+    }
+    for (t = 0; t < total_workers; t++) {
+        pthread_join(threads[t], NULL);
+    }
+    double total_ms = now_ms() - start;
+
+    long done = atomic_load(&job.processed[STAGE_WRITE]);
+    fprintf(stderr, "batch: %ld/%d images in %.1f ms (%.2f images/s)\n", done, job.count,
+            total_ms, total_ms > 0 ? done * 1000.0 / total_ms : 0.0);
+    fprintf(stderr, "%-8s %8s %8s %10s %10s %10s\n", "stage", "workers", "items", "busy ms",
+            "queue max", "queue avg");
+    for (int k = 0; k < NUM_STAGES; k++) {
+        long max_depth = 0;
+        double avg_depth = 0;
+        if (k > 0) {
+            long pushes = atomic_load(&job.queues[k].pushes);
+            max_depth = atomic_load(&job.queues[k].max_depth);
+            avg_depth = pushes ? (double)atomic_load(&job.queues[k].depth_sum) / pushes : 0.0;
+        }
+        fprintf(stderr, "%-8s %8d %8ld %10.1f %10ld %10.2f\n", stage_names[k], job.workers[k],
+                atomic_load(&job.processed[k]), atomic_load(&job.busy_us[k]) / 1000.0,
+                max_depth, avg_depth);
+    }
+
+    size_t peak_bytes = 0;
+    long table_seams[SC_NUM_TABLES] = {0};
+    long steps_down = 0;
+    for (t = 0; t < total_workers; t++) {
+        if (workers[t].ctx) {
+            peak_bytes += workers[t].ctx->peak_bytes;
+            for (int k = 0; k < workers[t].ctx->num_strips; k++) {
+                peak_bytes += workers[t].ctx->strips[k].peak_bytes;
+            }
+            for (int m = 0; m < SC_NUM_TABLES; m++) {
+                table_seams[m] += workers[t].ctx->table_seams[m];
+            }
+            steps_down += workers[t].ctx->steps_down;
+            sc_context_destroy(workers[t].ctx);
+        }
+    }
+    fprintf(stderr, "carve workspace: %.1f MB peak\n", peak_bytes / 1048576.0);
+    if (steps_down > 0) {
+        fprintf(stderr, "memory: %ld table steps down; seams by DP table:", steps_down);
+        for (int m = 0; m < SC_NUM_TABLES; m++) {
+            fprintf(stderr, " %s %ld", table_names[m], table_seams[m]);
+        }
+        fprintf(stderr, "\n");
+    }
+
+    long planned = 0;
+    for (int m = 0; m < SC_NUM_PLANS; m++) {
+        planned += atomic_load(&job.planned[m]);
+    }
+    if (planned > 0) {
+        fprintf(stderr, "plan: %ld exact, %ld banded, %ld strips; mean prediction error %.0f%%\n",
+                atomic_load(&job.planned[SC_PLAN_EXACT]), atomic_load(&job.planned[SC_PLAN_BANDED]),
+                atomic_load(&job.planned[SC_PLAN_STRIPS]),
+                atomic_load(&job.plan_error_sum) / 100.0 / planned);
+    }
+
+    for (int k = 1; k < NUM_STAGES; k++) {
+        sc_queue_destroy(&job.queues[k]);
+    }
+    free(threads);
+    free(workers);
+    free(job.items);
+
+    return atomic_load(&job.failed) ? 1 : 0;
+}
+
+// Part 3: Heatmap mode
+static int run_heatmap(int argc, char **argv) {
+    int kind = HEATMAP_ENERGY;
+    int size = 512;
+
+    for (int a = 0; a < argc; a++) {
+        if (!strcmp(argv[a], "--energy")) {
+            kind = HEATMAP_ENERGY;
+        }
+        else if (!strcmp(argv[a], "--cost")) {
+            kind = HEATMAP_COST;
+        }
+        else if (!strcmp(argv[a], "--size") && a + 1 < argc) {
+            size = atoi(argv[++a]);
+        }
+        else {
+            fprintf(stderr, "heatmap: unknown option %s\n", argv[a]);
+            return 2;
+        }
+    }
+    if (size < 1) {
+        fprintf(stderr, "heatmap: --size must be positive\n");
+        return 2;
+    }
+
+    uint8_t *pixels;
+    int height, width;
+    if (ppm_read(stdin, &pixels, &height, &width) != 1) {
+        fprintf(stderr, "heatmap: cannot read a PPM image from stdin\n");
+        return 1;
+    }
+
+    // Fit the longer side to size, never upscaling
+    int out_width = width;
+    int out_height = height;
+    if (width > size || height > size) {
+        double scale = (double)size / (width > height ? width : height);
+        out_width = (int)(width * scale) > 0 ? (int)(width * scale) : 1;
+        out_height = (int)(height * scale) > 0 ? (int)(height * scale) : 1;
+    }
+
+    uint8_t *gray = (uint8_t *)malloc((size_t)out_height * out_width);
+    heatmap(pixels, height, width, kind, gray, out_height, out_width);
+    int status = pgm_write(stdout, gray, out_height, out_width);
+
+    free(gray);
+    free(pixels);
+    sc_reset();
+    return status == 0 ? 0 : 1;
+}
+
+static void usage(void) {
+    fprintf(stderr,
+            "usage: seamcarving video (--seams N | --width W) [--band M] < in.ppm > out.ppm\n"
+            "  Carves a stream of binary PPM frames, e.g. from\n"
+            "  ffmpeg -i in.mp4 -f image2pipe -vcodec ppm -\n"
+            "usage: seamcarving batch JOBS (--seams N | --width W) [--band M] [--strips K]\n"
+            "                         [--workers read=1,decode=1,carve=N,encode=1,write=1] [--queue Q]\n"
+            "                         [--plan exact|high|fast] [--memory MB]\n"
+            "  Carves every \"input.ppm output.ppm [width]\" line of the JOBS file; --plan picks\n"
+            "  the fastest mode per image at that quality, and --memory caps the working set of\n"
+            "  every carve at MB, with smaller, slower DP tables if needed\n"
+            "usage: seamcarving carve (--seams N | --width W) [--band M] [--refresh R]\n"
+            "                         [--checkpoint FILE] [--every SECONDS] [--budget MS]\n"
+            "                         [--memory MB]\n"
+            "                         < in.ppm > out.ppm\n"
+            "  Carves one image, saving progress to FILE and resuming from it if present,\n"
+            "  or finishing within MS by falling back to faster modes\n"
+            "usage: seamcarving tune [--profile FILE]\n"
+            "  Benchmarks this machine and saves the engine settings the other modes use\n"
+            "usage: seamcarving heatmap [--energy | --cost] [--size N] < in.ppm > out.pgm\n"
+            "  Writes the energy or cumulative seam cost, at most N pixels on a side\n"
+            "usage: seamcarving serve [--port P] [--workers N] [--band M] [--memory MB]\n"
+            "  Serves POST /carve?width=W (or ?seams=N) with a PPM body on 127.0.0.1;\n"
+            "  add &priority=bulk and &deadline=MS to schedule backfill;\n"
+            "  GET /metrics reports Prometheus metrics\n");
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        usage();
+        return 2;
+    }
+    if (!strcmp(argv[1], "video")) {
+        return run_video(argc - 2, argv + 2);
+    }
+    if (!strcmp(argv[1], "batch")) {
+        return run_batch(argc - 2, argv + 2);
+    }
+    if (!strcmp(argv[1], "carve")) {
+        return run_carve(argc - 2, argv + 2);
+    }
+    if (!strcmp(argv[1], "tune")) {
+        return run_tune(argc - 2, argv + 2);
+    }
+    if (!strcmp(argv[1], "heatmap")) {
+        return run_heatmap(argc - 2, argv + 2);
+    }
+    if (!strcmp(argv[1], "serve")) {
+        return run_serve(argc - 2, argv + 2);
+    }
+
+    usage();
+    return 2;
+}
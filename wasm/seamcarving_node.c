@@ -0,0 +1,360 @@
+#include "seamcarving_wasm.h"
+#include <node_api.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+
+// Node.js addon over the native engine. Carves run as async work on the
+// libuv thread pool and resolve Promises. Inputs are read in place from
+// Buffers/TypedArrays and results are handed back as external Buffers, so
+// pixels are never copied between JavaScript and C.
+//
+// Exports, with the parameters of the WASM exports of the same name:
+// - carveSeams(pixels, height, width, numSeams, bandMargin, refreshInterval,
+//   strips) -> Promise<{ data, width, height, stats }>
+// - carveSeamsLanes(images, height, width, numSeams)
+//   -> Promise<{ images, width, height, stats }>
+// stats is { ms, workspaceBytes }.
+
+// Contexts kept for reuse, at most one per pool thread in practice
+#define MAX_IDLE_CONTEXTS 16
+
+static sc_context *idle_contexts[MAX_IDLE_CONTEXTS];
+static int num_idle_contexts = 0;
+static pthread_mutex_t contexts_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Helper function to take a context with warm buffers, if there is one
+static sc_context *acquire_context(void) {
+    sc_context *ctx = NULL;
+
+    pthread_mutex_lock(&contexts_lock);
+    if (num_idle_contexts > 0) {
+        ctx = idle_contexts[--num_idle_contexts];
+    }
+    pthread_mutex_unlock(&contexts_lock);
+
+    return ctx ? ctx : sc_context_create();
+}
+
+static void release_context(sc_context *ctx) {
+    pthread_mutex_lock(&contexts_lock);
+    if (num_idle_contexts < MAX_IDLE_CONTEXTS) {
+        idle_contexts[num_idle_contexts++] = ctx;
+        ctx = NULL;
+    }
+    pthread_mutex_unlock(&contexts_lock);
+
+    if (ctx) {
+        sc_context_destroy(ctx);
+    }
+}
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+// Bytes held by a context and its strip contexts at their peak
+static size_t peak_bytes(sc_context *ctx) {
+    size_t bytes = ctx->peak_bytes;
+    for (int k = 0; k < ctx->num_strips; k++) {
+        bytes += ctx->strips[k].peak_bytes;
+    }
+    return bytes;
+}
+
+typedef struct {
+    napi_async_work work;
+    napi_deferred deferred;
+    int num_inputs;
+    napi_ref *inputs;       // keep the input arrays alive while carving
+    uint8_t **srcs;
+    uint8_t **dests;
+    int height;
+    int width;
+    int num_seams;
+    int band_margin;
+    int refresh_interval;
+    int strips;
+    int lanes;              // carve with carve_seams_lanes
+    int status;             // 0, or -1 when the engine rejected the arguments
+    double ms;
+    size_t workspace_bytes;
+} carve_job;
+
+// Runs on a libuv pool thread; must not touch JavaScript values
+static void carve_execute(napi_env env, void *data) {
+    carve_job *job = (carve_job *)data;
+    sc_context *ctx = acquire_context();
+    double start = now_ms();
+    (void)env;
+
+    if (job->lanes) {
+        job->status = carve_seams_lanes_ctx(ctx, job->srcs, job->dests, job->num_inputs,
+                                            job->height, job->width, job->num_seams);
+    }
+    else {
+        job->dests[0] = carve_seams_strips_ctx(ctx, job->srcs[0], job->height, job->width,
+                                               job->num_seams, job->strips, job->band_margin,
+                                               job->refresh_interval);
+        job->status = job->dests[0] ? 0 : -1;
+    }
+
+    job->ms = now_ms() - start;
+    job->workspace_bytes = peak_bytes(ctx);
+    release_context(ctx);
+}
+
+static void free_output(napi_env env, void *data, void *hint) {
+    (void)env;
+    (void)hint;
+    free(data);
+}
+
+static void free_job(napi_env env, carve_job *job) {
+    for (int k = 0; k < job->num_inputs; k++) {
+        if (job->inputs[k]) {
+            napi_delete_reference(env, job->inputs[k]);
+        }
+    }
+    if (job->work) {
+        napi_delete_async_work(env, job->work);
+    }
+    free(job->inputs);
+    free(job->srcs);
+    free(job->dests);
+    free(job);
+}
+
+static napi_value make_int(napi_env env, int value) {
+    napi_value result;
+    napi_create_int32(env, value, &result);
+    return result;
+}
+
+static napi_value make_double(napi_env env, double value) {
+    napi_value result;
+    napi_create_double(env, value, &result);
+    return result;
+}
+
+static napi_value make_error(napi_env env, const char *message) {
+    napi_value text, error;
+    napi_create_string_utf8(env, message, NAPI_AUTO_LENGTH, &text);
+    napi_create_error(env, NULL, text, &error);
+    return error;
+}
+
+// Hand a carved image to JavaScript; the Buffer frees it when collected
+static napi_value wrap_output(napi_env env, uint8_t *pixels, size_t size) {
+    napi_value buffer;
+    if (napi_create_external_buffer(env, size, pixels, free_output, NULL, &buffer) != napi_ok) {
+        free(pixels);
+        return NULL;
+    }
+    return buffer;
+}
+
+// Back on the JavaScript thread: settle the Promise
+static void carve_complete(napi_env env, napi_status status, void *data) {
+    carve_job *job = (carve_job *)data;
+
+    if (status != napi_ok || job->status != 0) {
+        napi_reject_deferred(env, job->deferred,
+                             make_error(env, status != napi_ok ? "Carve was cancelled"
+                                                               : "Invalid carve parameters"));
+        free_job(env, job);
+        return;
+    }
+
+    int new_width = job->width - job->num_seams;
+    size_t size = (size_t)job->height * new_width * 4;
+    napi_value result, stats;
+    napi_create_object(env, &result);
+    napi_create_object(env, &stats);
+
+    if (job->lanes) {
+        napi_value images;
+        napi_create_array_with_length(env, job->num_inputs, &images);
+        for (int k = 0; k < job->num_inputs; k++) {
+            napi_set_element(env, images, k, wrap_output(env, job->dests[k], size));
+        }
+        napi_set_named_property(env, result, "images", images);
+    }
+    else {
+        napi_set_named_property(env, result, "data", wrap_output(env, job->dests[0], size));
+    }
+    napi_set_named_property(env, result, "width", make_int(env, new_width));
+    napi_set_named_property(env, result, "height", make_int(env, job->height));
+    napi_set_named_property(env, stats, "ms", make_double(env, job->ms));
+    napi_set_named_property(env, stats, "workspaceBytes",
+                            make_double(env, (double)job->workspace_bytes));
+    napi_set_named_property(env, result, "stats", stats);
+
+    napi_resolve_deferred(env, job->deferred, result);
+    free_job(env, job);
+}
+
+// Helper function to get the bytes behind a Buffer or TypedArray without copying
+static int pixels_of(napi_env env, napi_value value, uint8_t **data, size_t *size) {
+    bool is_typedarray = false;
+    napi_is_typedarray(env, value, &is_typedarray);
+
+    if (is_typedarray) {
+        napi_typedarray_type type;
+        size_t length, offset;
+        napi_value arraybuffer;
+        void *base;
+        if (napi_get_typedarray_info(env, value, &type, &length, &base, &arraybuffer, &offset) != napi_ok ||
+            (type != napi_uint8_array && type != napi_uint8_clamped_array)) {
+            return 0;
+        }
+        *data = (uint8_t *)base;
+        *size = length;
+        return 1;
+    }
+
+    void *base;
+    if (napi_get_buffer_info(env, value, &base, size) != napi_ok) {
+        return 0;
+    }
+    *data = (uint8_t *)base;
+    return 1;
+}
+
+// Helper function to read the integer arguments from first on
+static int int_args(napi_env env, napi_value *argv, size_t argc, size_t first, int *out, int count) {
+    for (int k = 0; k < count; k++) {
+        out[k] = 0;
+        if (first + k < argc) {
+            napi_valuetype type;
+            napi_typeof(env, argv[first + k], &type);
+            if (type == napi_undefined) {
+                continue;
+            }
+            if (napi_get_value_int32(env, argv[first + k], &out[k]) != napi_ok) {
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+// Queue a job and return its Promise, or throw on bad arguments
+static napi_value start_job(napi_env env, carve_job *job, napi_value *inputs, const char *error) {
+    if (error) {
+        free_job(env, job);
+        napi_throw_type_error(env, NULL, error);
+        return NULL;
+    }
+
+    for (int k = 0; k < job->num_inputs; k++) {
+        napi_create_reference(env, inputs[k], 1, &job->inputs[k]);
+    }
+
+    napi_value promise, name;
+    napi_create_promise(env, &job->deferred, &promise);
+    napi_create_string_utf8(env, "seamcarving", NAPI_AUTO_LENGTH, &name);
+    napi_create_async_work(env, NULL, name, carve_execute, carve_complete, job, &job->work);
+    napi_queue_async_work(env, job->work);
+    return promise;
+}
+
+static carve_job *new_job(int num_inputs) {
+    carve_job *job = (carve_job *)calloc(1, sizeof(carve_job));
+    job->num_inputs = num_inputs;
+    job->inputs = (napi_ref *)calloc(num_inputs, sizeof(napi_ref));
+    job->srcs = (uint8_t **)calloc(num_inputs, sizeof(uint8_t *));
+    job->dests = (uint8_t **)calloc(num_inputs, sizeof(uint8_t *));
+    return job;
+}
+
+static napi_value carve_seams_js(napi_env env, napi_callback_info info) {
+    size_t argc = 7;
+    napi_value argv[7];
+    napi_get_cb_info(env, info, &argc, argv, NULL, NULL);
+
+    carve_job *job = new_job(1);
+    int args[6];
+    size_t size = 0;
+    const char *error = NULL;
+
+    if (argc < 4 || !pixels_of(env, argv[0], &job->srcs[0], &size)) {
+        error = "carveSeams expects (pixels, height, width, numSeams, ...)";
+    }
+    else if (!int_args(env, argv, argc, 1, args, 6)) {
+        error = "carveSeams expects integer parameters";
+    }
+    else {
+        job->height = args[0];
+        job->width = args[1];
+        job->num_seams = args[2];
+        job->band_margin = args[3];
+        job->refresh_interval = args[4];
+        job->strips = args[5];
+        if (job->height <= 0 || job->width <= 0 || size < (size_t)job->height * job->width * 4) {
+            error = "pixels must hold height * width RGBA pixels";
+        }
+    }
+
+    return start_job(env, job, argv, error);
+}
+
+static napi_value carve_seams_lanes_js(napi_env env, napi_callback_info info) {
+    size_t argc = 4;
+    napi_value argv[4];
+    napi_get_cb_info(env, info, &argc, argv, NULL, NULL);
+
+    bool is_array = false;
+    uint32_t count = 0;
+    if (argc > 0) {
+        napi_is_array(env, argv[0], &is_array);
+    }
+    if (is_array) {
+        napi_get_array_length(env, argv[0], &count);
+    }
+
+    carve_job *job = new_job(count > 0 ? count : 1);
+    job->num_inputs = count;
+    job->lanes = 1;
+    napi_value *inputs = (napi_value *)calloc(count > 0 ? count : 1, sizeof(napi_value));
+    int args[3];
+    const char *error = NULL;
+
+    if (argc < 4 || !is_array || count == 0) {
+        error = "carveSeamsLanes expects (images, height, width, numSeams)";
+    }
+    else if (!int_args(env, argv, argc, 1, args, 3)) {
+        error = "carveSeamsLanes expects integer parameters";
+    }
+    else {
+        job->height = args[0];
+        job->width = args[1];
+        job->num_seams = args[2];
+        for (uint32_t k = 0; k < count && !error; k++) {
+            size_t size = 0;
+            napi_get_element(env, argv[0], k, &inputs[k]);
+            if (!pixels_of(env, inputs[k], &job->srcs[k], &size) || job->height <= 0 ||
+                job->width <= 0 || size < (size_t)job->height * job->width * 4) {
+                error = "every image must hold height * width RGBA pixels";
+            }
+        }
+    }
+
+    napi_value promise = start_job(env, job, inputs, error);
+    free(inputs);
+    return promise;
+}
+
+static napi_value init(napi_env env, napi_value exports) {
+    napi_property_descriptor properties[] = {
+        { "carveSeams", NULL, carve_seams_js, NULL, NULL, NULL, napi_default, NULL },
+        { "carveSeamsLanes", NULL, carve_seams_lanes_js, NULL, NULL, NULL, napi_default, NULL },
+    };
+    napi_define_properties(env, exports, sizeof(properties) / sizeof(properties[0]), properties);
+    return exports;
+}
+
+NAPI_MODULE(NODE_GYP_MODULE_NAME, init)
@@ -0,0 +1,71 @@
+/**
+ * Node.js Backend
+ *
+ * Loads the native addon (build with ./build_node.sh) and exposes the same
+ * functions as src/utils/wasmUtils.js, so server code can swap the browser
+ * WebAssembly build for the native engine with its SIMD and strip threads:
+ * - processImage(imageData, seamCount, options)
+ * - processImageBatch(imageDatas, seamCount)
+ *
+ * imageData is anything with { data, width, height } where data is a Buffer,
+ * Uint8Array or Uint8ClampedArray of RGBA pixels; it is read in place, not
+ * copied. Results are { data, width, height, stats } with data a
+ * Uint8ClampedArray over the engine's output and stats { ms, workspaceBytes }.
+ * Carves run on the libuv thread pool (UV_THREADPOOL_SIZE bounds how many
+ * run at once), so the event loop never blocks.
+ */
+
+import { createRequire } from "module";
+
+const require = createRequire(import.meta.url);
+const addon = require("./build/seamcarving.node");
+
+// View the engine's output Buffer as pixels without copying it
+const pixelsOf = (buffer) =>
+  new Uint8ClampedArray(buffer.buffer, buffer.byteOffset, buffer.length);
+
+// Options are as for processImage in wasmUtils.js: bandMargin,
+// refreshInterval and strips
+export const processImage = async (imageData, seamCount = 1, options = {}) => {
+  const { bandMargin = 0, refreshInterval = 0, strips = 1 } = options;
+  const { data, width, height } = imageData;
+
+  const result = await addon
+    .carveSeams(
+      data,
+      height,
+      width,
+      seamCount,
+      bandMargin,
+      refreshInterval,
+      strips
+    )
+    .catch(() => {
+      throw new Error(
+        `Cannot remove ${seamCount} seams from a ${width}px wide image`
+      );
+    });
+  return { ...result, data: pixelsOf(result.data) };
+};
+
+// Carve many same-sized images with one image per SIMD lane
+export const processImageBatch = async (imageDatas, seamCount = 1) => {
+  const { width, height } = imageDatas[0];
+
+  if (imageDatas.some((img) => img.width !== width || img.height !== height)) {
+    throw new Error("All images in a batch must have the same dimensions");
+  }
+
+  const { images, stats } = await addon.carveSeamsLanes(
+    imageDatas.map((img) => img.data),
+    height,
+    width,
+    seamCount
+  );
+  return images.map((buffer) => ({
+    data: pixelsOf(buffer),
+    width: width - seamCount,
+    height,
+    stats,
+  }));
+};
@@ -0,0 +1,412 @@
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include "seamcarving_wasm.h"
+#include <stdlib.h>
+#include <string.h>
+
+// CPython extension over the native engine.
+//
+// Images are any C-contiguous buffer of uint8 shaped height x width x 3 or
+// height x width x 4 (a NumPy array, bytes with an explicit shape, ...).
+// 4-channel input is read in place; 3-channel input is widened to RGBA on the
+// way in. The GIL is released while carving, so Python threads carve in
+// parallel. Results are Image objects owning the engine's output; they
+// export it through the buffer protocol, so numpy.asarray(result) shares it
+// rather than copying.
+//
+//   ctx = seamcarving.Context()
+//   out = numpy.asarray(ctx.carve(img, 100, band_margin=16))
+//   outs = [numpy.asarray(o) for o in ctx.carve_batch(thumbs, 20)]
+//
+// A Context keeps its working buffers between calls, so carving many images
+// of similar size allocates only once. One Context carves one image at a
+// time; give each thread its own.
+
+// Part 1: Image, the result type
+typedef struct {
+    PyObject_HEAD
+    uint8_t *pixels;
+    Py_ssize_t shape[3];
+    Py_ssize_t strides[3];
+} ImageObject;
+
+static void Image_dealloc(ImageObject *self) {
+    free(self->pixels);
+    Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+static int Image_getbuffer(ImageObject *self, Py_buffer *view, int flags) {
+    if (PyBuffer_FillInfo(view, (PyObject *)self, self->pixels,
+                          self->shape[0] * self->shape[1] * self->shape[2], 0, flags) < 0) {
+        return -1;
+    }
+    if (flags & PyBUF_ND) {
+        view->ndim = 3;
+        view->shape = self->shape;
+    }
+    if ((flags & PyBUF_STRIDES) == PyBUF_STRIDES) {
+        view->strides = self->strides;
+    }
+    return 0;
+}
+
+static PyBufferProcs Image_as_buffer = {
+    (getbufferproc)Image_getbuffer,
+    NULL,
+};
+
+static PyObject *Image_get_shape(ImageObject *self, void *closure) {
+    (void)closure;
+    return Py_BuildValue("(nnn)", self->shape[0], self->shape[1], self->shape[2]);
+}
+
+static PyGetSetDef Image_getset[] = {
+    {"shape", (getter)Image_get_shape, NULL, "(height, width, channels)", NULL},
+    {NULL},
+};
+
+static PyTypeObject ImageType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "seamcarving.Image",
+    .tp_doc = "A carved image; read it with numpy.asarray or memoryview",
+    .tp_basicsize = sizeof(ImageObject),
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_dealloc = (destructor)Image_dealloc,
+    .tp_as_buffer = &Image_as_buffer,
+    .tp_getset = Image_getset,
+};
+
+// Wrap engine output (RGBA, malloc'd) as an Image with the caller's channel
+// count. 3-channel output is packed in place, so ownership always moves.
+static PyObject *new_image(uint8_t *rgba, int height, int width, int channels) {
+    ImageObject *image = PyObject_New(ImageObject, &ImageType);
+    if (!image) {
+        free(rgba);
+        return NULL;
+    }
+
+    if (channels == 3) {
+        for (long k = 0; k < (long)height * width; k++) {
+            memmove(rgba + 3 * k, rgba + 4 * k, 3);
+        }
+    }
+    image->pixels = rgba;
+    image->shape[0] = height;
+    image->shape[1] = width;
+    image->shape[2] = channels;
+    image->strides[0] = (Py_ssize_t)width * channels;
+    image->strides[1] = channels;
+    image->strides[2] = 1;
+    return (PyObject *)image;
+}
+
+// Part 2: Input images
+typedef struct {
+    Py_buffer view;
+    int height;
+    int width;
+    int channels;
+    uint8_t *rgba;      // view.buf, or a widened copy of 3-channel input
+} input_image;
+
+// Helper function to read an image argument without copying 4-channel data.
+// Returns 0, or -1 with an exception set.
+static int get_input(PyObject *obj, input_image *in) {
+    if (PyObject_GetBuffer(obj, &in->view, PyBUF_C_CONTIGUOUS | PyBUF_FORMAT) < 0) {
+        return -1;
+    }
+
+    Py_buffer *view = &in->view;
+    if (view->itemsize != 1 || (view->format && strcmp(view->format, "B") != 0) ||
+        view->ndim != 3 || (view->shape[2] != 3 && view->shape[2] != 4) ||
+        view->shape[0] <= 0 || view->shape[1] <= 0 ||
+        view->shape[0] > INT32_MAX / 4 || view->shape[1] > INT32_MAX / 4) {
+        PyBuffer_Release(view);
+        PyErr_SetString(PyExc_ValueError,
+                        "expected a C-contiguous uint8 array of shape (height, width, 3 or 4)");
+        return -1;
+    }
+
+    in->height = (int)view->shape[0];
+    in->width = (int)view->shape[1];
+    in->channels = (int)view->shape[2];
+    in->rgba = (uint8_t *)view->buf;
+
+    if (in->channels == 3) {
+        long pixels = (long)in->height * in->width;
+        uint8_t *src = (uint8_t *)view->buf;
+        in->rgba = (uint8_t *)malloc(pixels * 4);
+        if (!in->rgba) {
+            PyBuffer_Release(view);
+            PyErr_NoMemory();
+            return -1;
+        }
+        for (long k = 0; k < pixels; k++) {
+            memcpy(in->rgba + 4 * k, src + 3 * k, 3);
+            in->rgba[4 * k + 3] = 255;
+        }
+    }
+    return 0;
+}
+
+static void release_input(input_image *in) {
+    if (in->rgba != in->view.buf) {
+        free(in->rgba);
+    }
+    PyBuffer_Release(&in->view);
+}
+
+// Part 3: Context
+typedef struct {
+    PyObject_HEAD
+    sc_context *ctx;
+    PyThread_type_lock lock;    // one carve at a time per context
+} ContextObject;
+
+// The context and lock are made here rather than in __init__, so methods
+// can rely on them even when __init__ is skipped
+static PyObject *Context_new(PyTypeObject *type, PyObject *args, PyObject *kwds) {
+    (void)args;
+    (void)kwds;
+    ContextObject *self = (ContextObject *)type->tp_alloc(type, 0);
+    if (!self) {
+        return NULL;
+    }
+    self->ctx = sc_context_create();
+    self->lock = PyThread_allocate_lock();
+    if (!self->ctx || !self->lock) {
+        Py_DECREF(self);
+        return PyErr_NoMemory();
+    }
+    return (PyObject *)self;
+}
+
+static int Context_init(ContextObject *self, PyObject *args, PyObject *kwds) {
+    static char *kwlist[] = {NULL};
+    (void)self;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "", kwlist)) {
+        return -1;
+    }
+    return 0;
+}
+
+static void Context_dealloc(ContextObject *self) {
+    if (self->ctx) {
+        sc_context_destroy(self->ctx);
+    }
+    if (self->lock) {
+        PyThread_free_lock(self->lock);
+    }
+    Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+static PyObject *Context_carve(ContextObject *self, PyObject *args, PyObject *kwds) {
+    static char *kwlist[] = {"image", "seams", "band_margin", "refresh_interval", "strips", NULL};
+    PyObject *obj;
+    int num_seams;
+    int band_margin = 0;
+    int refresh_interval = 0;
+    int strips = 1;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "Oi|iii", kwlist, &obj, &num_seams,
+                                     &band_margin, &refresh_interval, &strips)) {
+        return NULL;
+    }
+
+    input_image in;
+    if (get_input(obj, &in) < 0) {
+        return NULL;
+    }
+    if (num_seams < 0 || num_seams >= in.width) {
+        release_input(&in);
+        return PyErr_Format(PyExc_ValueError, "cannot remove %d seams from a %d pixel wide image",
+                            num_seams, in.width);
+    }
+
+    uint8_t *output;
+    Py_BEGIN_ALLOW_THREADS
+    PyThread_acquire_lock(self->lock, WAIT_LOCK);
+    output = carve_seams_strips_ctx(self->ctx, in.rgba, in.height, in.width, num_seams,
+                                    strips, band_margin, refresh_interval);
+    PyThread_release_lock(self->lock);
+    Py_END_ALLOW_THREADS
+
+    int height = in.height;
+    int channels = in.channels;
+    release_input(&in);
+    if (!output) {
+        return PyErr_NoMemory();
+    }
+    return new_image(output, height, in.width - num_seams, channels);
+}
+
+static PyObject *Context_carve_batch(ContextObject *self, PyObject *args) {
+    PyObject *seq;
+    int num_seams;
+
+    if (!PyArg_ParseTuple(args, "Oi", &seq, &num_seams)) {
+        return NULL;
+    }
+    PyObject *items = PySequence_Fast(seq, "carve_batch expects a sequence of images");
+    if (!items) {
+        return NULL;
+    }
+
+    Py_ssize_t count = PySequence_Fast_GET_SIZE(items);
+    input_image *ins = (input_image *)calloc(count > 0 ? count : 1, sizeof(input_image));
+    uint8_t **srcs = (uint8_t **)calloc(count > 0 ? count : 1, sizeof(uint8_t *));
+    uint8_t **dests = (uint8_t **)calloc(count > 0 ? count : 1, sizeof(uint8_t *));
+    PyObject *result = NULL;
+    Py_ssize_t ready = 0;
+
+    if (!ins || !srcs || !dests) {
+        PyErr_NoMemory();
+        goto done;
+    }
+    if (count == 0) {
+        result = PyList_New(0);
+        goto done;
+    }
+
+    for (; ready < count; ready++) {
+        if (get_input(PySequence_Fast_GET_ITEM(items, ready), &ins[ready]) < 0) {
+            goto done;
+        }
+        srcs[ready] = ins[ready].rgba;
+        if (ins[ready].height != ins[0].height || ins[ready].width != ins[0].width ||
+            ins[ready].channels != ins[0].channels) {
+            release_input(&ins[ready]);
+            PyErr_SetString(PyExc_ValueError, "all images in a batch must have the same shape");
+            goto done;
+        }
+    }
+    if (num_seams < 0 || num_seams >= ins[0].width) {
+        PyErr_Format(PyExc_ValueError, "cannot remove %d seams from a %d pixel wide image",
+                     num_seams, ins[0].width);
+        goto done;
+    }
+
+    int status;
+    Py_BEGIN_ALLOW_THREADS
+    PyThread_acquire_lock(self->lock, WAIT_LOCK);
+    status = carve_seams_lanes_ctx(self->ctx, srcs, dests, (int)count, ins[0].height,
+                                   ins[0].width, num_seams);
+    PyThread_release_lock(self->lock);
+    Py_END_ALLOW_THREADS
+
+    if (status != 0) {
+        PyErr_SetString(PyExc_ValueError, "invalid batch");
+        goto done;
+    }
+
+    result = PyList_New(count);
+    for (Py_ssize_t k = 0; k < count; k++) {
+        PyObject *image = new_image(dests[k], ins[0].height, ins[0].width - num_seams,
+                                    ins[0].channels);
+        dests[k] = NULL;
+        if (!result || !image) {
+            Py_XDECREF(image);
+            Py_CLEAR(result);
+            continue;
+        }
+        PyList_SET_ITEM(result, k, image);
+    }
+
+done:
+    for (Py_ssize_t k = 0; k < ready; k++) {
+        release_input(&ins[k]);
+    }
+    for (Py_ssize_t k = 0; dests && k < count; k++) {
+        free(dests[k]);
+    }
+    free(ins);
+    free(srcs);
+    free(dests);
+    Py_DECREF(items);
+    return result;
+}
+
+static PyObject *Context_reset(ContextObject *self, PyObject *unused) {
+    (void)unused;
+    Py_BEGIN_ALLOW_THREADS
+    PyThread_acquire_lock(self->lock, WAIT_LOCK);
+    sc_context_reset(self->ctx);
+    PyThread_release_lock(self->lock);
+    Py_END_ALLOW_THREADS
+    Py_RETURN_NONE;
+}
+
+// Bytes held at the peak by the context and its strip contexts
+static PyObject *Context_get_peak_bytes(ContextObject *self, void *closure) {
+    (void)closure;
+    size_t bytes = self->ctx->peak_bytes;
+    for (int k = 0; k < self->ctx->num_strips; k++) {
+        bytes += self->ctx->strips[k].peak_bytes;
+    }
+    return PyLong_FromSize_t(bytes);
+}
+
+static PyObject *Context_get_bytes(ContextObject *self, void *closure) {
+    (void)closure;
+    size_t bytes = self->ctx->bytes;
+    for (int k = 0; k < self->ctx->num_strips; k++) {
+        bytes += self->ctx->strips[k].bytes;
+    }
+    return PyLong_FromSize_t(bytes);
+}
+
+static PyMethodDef Context_methods[] = {
+    {"carve", (PyCFunction)(void (*)(void))Context_carve, METH_VARARGS | METH_KEYWORDS,
+     "carve(image, seams, band_margin=0, refresh_interval=0, strips=1) -> Image"},
+    {"carve_batch", (PyCFunction)Context_carve_batch, METH_VARARGS,
+     "carve_batch(images, seams) -> list of Image; same-shaped images, one per SIMD lane"},
+    {"reset", (PyCFunction)Context_reset, METH_NOARGS, "Free the working buffers"},
+    {NULL},
+};
+
+static PyGetSetDef Context_getset[] = {
+    {"workspace_bytes", (getter)Context_get_bytes, NULL, "Bytes of working buffers held", NULL},
+    {"peak_workspace_bytes", (getter)Context_get_peak_bytes, NULL,
+     "Most bytes of working buffers held at once", NULL},
+    {NULL},
+};
+
+static PyTypeObject ContextType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "seamcarving.Context",
+    .tp_doc = "Carving context that reuses its working buffers between images",
+    .tp_basicsize = sizeof(ContextObject),
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_new = Context_new,
+    .tp_init = (initproc)Context_init,
+    .tp_dealloc = (destructor)Context_dealloc,
+    .tp_methods = Context_methods,
+    .tp_getset = Context_getset,
+};
+
+// Part 4: Module
+static struct PyModuleDef seamcarving_module = {
+    PyModuleDef_HEAD_INIT,
+    .m_name = "seamcarving",
+    .m_doc = "Content-aware image resizing with the native seam carving engine",
+    .m_size = -1,
+};
+
+PyMODINIT_FUNC PyInit_seamcarving(void) {
+    if (PyType_Ready(&ImageType) < 0 || PyType_Ready(&ContextType) < 0) {
+        return NULL;
+    }
+
+    PyObject *module = PyModule_Create(&seamcarving_module);
+    if (!module) {
+        return NULL;
+    }
+    Py_INCREF(&ImageType);
+    Py_INCREF(&ContextType);
+    if (PyModule_AddObject(module, "Image", (PyObject *)&ImageType) < 0 ||
+        PyModule_AddObject(module, "Context", (PyObject *)&ContextType) < 0) {
+        Py_DECREF(module);
+        return NULL;
+    }
+    return module;
+}
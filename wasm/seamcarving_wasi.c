@@ -0,0 +1,158 @@
+#include "seamcarving.h"
+#include "c_img.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Batch entry point for the WASI build of the core library. One run carves
+// every job of a job list, so a sandboxed runtime compiles and instantiates
+// the module once per list rather than once per image.
+//
+// Each line of the job list is "input output seams", where input and output
+// are images in the c_img format and relative paths are taken from the job
+// list's directory. Under WASI every file must lie in a preopened directory.
+
+#define MAX_PATH 1024
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+// Helper function to resolve a job path against the job list's directory
+static void job_path(char *dest, const char *dir, const char *path) {
+    if (path[0] == '/' || dir[0] == '\0') {
+        snprintf(dest, MAX_PATH, "%s", path);
+    }
+    else {
+        snprintf(dest, MAX_PATH, "%s/%s", dir, path);
+    }
+}
+
+// Remove num_seams vertical seams, replacing *im. The image is kept as gap
+// buffers while carving, so each removal only moves the pixels between it
+// and the last seam in that row. Returns 0, -1 if the image is not wide
+// enough or -2 if memory runs out; *im is NULL after a -2.
+static int carve(struct rgb_img **im, int num_seams) {
+    if (num_seams < 0 || (size_t)num_seams >= (*im)->width) {
+        return -1;
+    }
+
+    struct gap_img *gi;
+    if (create_gap_img(&gi, *im) != 0) {
+        return -2;
+    }
+    destroy_image(*im);
+    *im = NULL;
+
+    for (int s = 0; s < num_seams; s++) {
+        struct rgb_img *grad = NULL;
+        double *best = NULL;
+        int *path = NULL;
+
+        int status = calc_energy_gap(gi, &grad);
+        if (status == 0) {
+            status = dynamic_seam(grad, &best);
+        }
+        if (status == 0) {
+            status = recover_path(best, grad->height, grad->width, &path);
+        }
+        if (status == 0) {
+            gap_remove_seam(gi, path);
+        }
+
+        if (grad) {
+            destroy_image(grad);
+        }
+        free(best);
+        free(path);
+        if (status != 0) {
+            destroy_gap_img(gi);
+            return -2;
+        }
+    }
+    return finalize_gap_img(gi, im) == 0 ? 0 : -2;
+}
+
+int main(int argc, char **argv) {
+    if (argc != 2) {
+        fprintf(stderr, "usage: seamcarving_wasi JOBS\n"
+                        "  Carves every \"input output seams\" line of the JOBS file\n");
+        return 2;
+    }
+
+    FILE *jobs = fopen(argv[1], "r");
+    if (!jobs) {
+        fprintf(stderr, "seamcarving_wasi: cannot open %s\n", argv[1]);
+        return 1;
+    }
+
+    char dir[MAX_PATH];
+    snprintf(dir, sizeof(dir), "%s", argv[1]);
+    char *slash = strrchr(dir, '/');
+    if (slash) {
+        *slash = '\0';
+    }
+    else {
+        dir[0] = '\0';
+    }
+
+    char line[2 * MAX_PATH + 32];
+    int done = 0;
+    int failed = 0;
+    double start = now_ms();
+
+    while (fgets(line, sizeof(line), jobs)) {
+        char input[MAX_PATH], output[MAX_PATH];
+        char input_path[MAX_PATH], output_path[MAX_PATH];
+        int num_seams;
+
+        if (line[0] == '#' || line[strspn(line, " \t\r\n")] == '\0') {
+            continue;
+        }
+        if (sscanf(line, "%1023s %1023s %d", input, output, &num_seams) != 3) {
+            fprintf(stderr, "seamcarving_wasi: bad job line: %s", line);
+            failed++;
+            continue;
+        }
+        job_path(input_path, dir, input);
+        job_path(output_path, dir, output);
+
+        struct rgb_img *im;
+        double job_start = now_ms();
+        if (read_in_img(&im, input_path) != 0) {
+            fprintf(stderr, "seamcarving_wasi: cannot read %s\n", input_path);
+            failed++;
+            continue;
+        }
+        int status = carve(&im, num_seams);
+        if (status == -2) {
+            fprintf(stderr, "seamcarving_wasi: out of memory carving %s\n", input_path);
+        }
+        else if (status != 0) {
+            fprintf(stderr, "seamcarving_wasi: cannot remove %d seams from %s\n", num_seams,
+                    input_path);
+        }
+        else if ((status = write_img(im, output_path)) != 0) {
+            fprintf(stderr, "seamcarving_wasi: cannot write %s\n", output_path);
+        }
+        if (im) {
+            destroy_image(im);
+        }
+
+        if (status != 0) {
+            failed++;
+            continue;
+        }
+        done++;
+        fprintf(stderr, "%s -> %s: %d seams in %.1f ms\n", input, output, num_seams,
+                now_ms() - job_start);
+    }
+    fclose(jobs);
+
+    fprintf(stderr, "seamcarving_wasi: %d images in %.1f ms, %d failed\n", done,
+            now_ms() - start, failed);
+    return failed ? 1 : 0;
+}
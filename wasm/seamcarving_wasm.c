@@ -1,7 +1,80 @@
+#ifdef __EMSCRIPTEN__
 #include <emscripten.h>
+#else
+#define EMSCRIPTEN_KEEPALIVE
+#endif
+#include "seamcarving_wasm.h"
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
 #include <math.h>
+#include <time.h>
+#ifdef SC_THREADS
+#include <pthread.h>
+#include <stdatomic.h>
+#include <limits.h>
+#include <sched.h>
+#if defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#elif defined(__EMSCRIPTEN__)
+#include <emscripten/threading.h>
+#endif
+#endif
+
+// Banded seams may cost this much more than the last exact seam before
+// carve_seams falls back to a full DP
+#define BAND_DRIFT_TOLERANCE 1.25
+
+// carve_seams_strips never splits the image into strips narrower than this
+#define MIN_STRIP_WIDTH 16
+
+// carve_seams_lanes packs one image per lane of a vector this wide: 8 x int32
+// with AVX2, otherwise 4 x int32 (SSE2, NEON or WASM SIMD128)
+#if defined(__AVX2__)
+#define SC_LANES 8
+#else
+#define SC_LANES 4
+#endif
+typedef int32_t lane_vec __attribute__((vector_size(SC_LANES * sizeof(int32_t))));
+
+// The same vectors split into uint16 lanes carry twice the images for the
+// DP: 8 x uint16 (i16x8 under WASM SIMD128), or 16 with AVX2.
+// LANES16_ORDER concatenates two lane_vecs.
+#define SC_LANES16 (2 * SC_LANES)
+typedef uint16_t lane16_vec __attribute__((vector_size(SC_LANES16 * sizeof(uint16_t))));
+#if defined(__AVX2__)
+#define LANES16_ORDER 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15
+#else
+#define LANES16_ORDER 0, 1, 2, 3, 4, 5, 6, 7
+#endif
+
+// Band margin of the banded mode that carve_seams_budget_ctx and
+// sc_plan_carve fall back to. Strip counts and the times they assume before
+// measuring come from the tuning.
+#define FAST_BAND_MARGIN 16
+// Banded seams it times before judging whether banding will finish in time
+#define BUDGET_SAMPLES 4
+
+// sc_flat_fraction samples at most this many pixels per side, and counts a
+// pixel as flat below this energy (of 0..62)
+#define FLAT_SAMPLES 64
+#define FLAT_ENERGY 2
+
+// sc_plan_carve lets SC_QUALITY_HIGH use strips from this flat fraction up
+#define FLAT_STRIPS_FRACTION 0.75
+
+// Threads of a parallel exact carve spin this many times at a barrier before
+// they sleep, which covers the few microseconds between phases
+#define BARRIER_SPINS 4000
+// Rows of the DP a parallel carve fills between two barriers, at most half
+// the width of a column block
+#define DP_CHUNK_ROWS 64
+
+// video_carve_frame treats a frame as a scene cut and carves it from scratch
+// when more than this fraction of its pixels changed
+#define SCENE_CUT_FRACTION 0.5
 
 // Define structures similar to the original code but optimized for WASM
 typedef struct {
@@ -10,6 +83,154 @@ typedef struct {
     int width;
 } rgb_img;
 
+// Context slots; a slot is plain scratch space, so unrelated carves may use
+// the same slot for buffers of different types
+enum { SLOT_WORK, SLOT_ENERGY, SLOT_COST, SLOT_PATH, SLOT_LO, SLOT_HI, SLOT_INDEX };
+
+// Slot buffers are aligned for the widest SIMD vector in use (AVX2)
+#define SC_ALIGN 32
+#define ALIGN_UP(bytes) (((bytes) + SC_ALIGN - 1) / SC_ALIGN * SC_ALIGN)
+
+// Context behind the exported functions that do not take one
+static sc_context default_ctx;
+
+// Machine-dependent choices. These defaults suit any machine until an
+// autotune profile replaces them (sc_set_tuning).
+static sc_tuning tuning = { 0, 4, 15.0, 0, 0, 10.0, 1, 0, SC_PIPELINE_ROWS, 0 };
+
+// Get a scratch buffer of at least `bytes` from a context slot. The buffer is
+// only reallocated when it has to grow, and its old contents are not kept.
+static void *ctx_buffer(sc_context *ctx, int slot, size_t bytes) {
+    if (ctx->caps[slot] < bytes) {
+        size_t cap = ALIGN_UP(bytes);
+
+        free(ctx->slots[slot]);
+        ctx->bytes -= ctx->caps[slot];
+        ctx->slots[slot] = aligned_alloc(SC_ALIGN, cap);
+        ctx->caps[slot] = ctx->slots[slot] ? cap : 0;
+        ctx->bytes += ctx->caps[slot];
+        if (ctx->bytes > ctx->peak_bytes) {
+            ctx->peak_bytes = ctx->bytes;
+        }
+    }
+    return ctx->slots[slot];
+}
+
+// ctx_buffer for a context over its memory limit: a slot larger than needed
+// is given back first instead of being kept for later
+static void *ctx_buffer_fit(sc_context *ctx, int slot, size_t bytes) {
+    if (ctx->memory_limit > 0 && ctx->bytes > ctx->memory_limit &&
+        ctx->caps[slot] > ALIGN_UP(bytes)) {
+        free(ctx->slots[slot]);
+        ctx->bytes -= ctx->caps[slot];
+        ctx->slots[slot] = NULL;
+        ctx->caps[slot] = 0;
+    }
+    return ctx_buffer(ctx, slot, bytes);
+}
+
+sc_context *sc_context_create(void) {
+    return (sc_context *)calloc(1, sizeof(sc_context));
+}
+
+// Release every buffer held by a context; it stays usable
+void sc_context_reset(sc_context *ctx) {
+    for (int slot = 0; slot < SC_NUM_SLOTS; slot++) {
+        free(ctx->slots[slot]);
+        ctx->slots[slot] = NULL;
+        ctx->caps[slot] = 0;
+    }
+    ctx->bytes = 0;
+    ctx->table = SC_TABLE_FULL;
+
+    for (int k = 0; k < ctx->num_strips; k++) {
+        sc_context_reset(&ctx->strips[k]);
+    }
+    free(ctx->strips);
+    ctx->strips = NULL;
+    ctx->num_strips = 0;
+}
+
+void sc_context_destroy(sc_context *ctx) {
+    sc_context_reset(ctx);
+    free(ctx);
+}
+
+// Bytes of working set carve_seams needs for a height x width image
+EMSCRIPTEN_KEEPALIVE
+size_t sc_workspace_bytes(int height, int width) {
+    size_t pixels = (size_t)height * width;
+    return pixels * 4            // work copy of the image
+         + pixels * 4            // energy map
+         + pixels * sizeof(double)   // cumulative cost
+         + 3 * (size_t)height * sizeof(int)   // path and window bounds
+         + SC_NUM_SLOTS * SC_ALIGN;
+}
+
+// Bytes a carve of a height x width image holds at its peak in the given
+// mode (SC_MODE_*): the context's working set plus the buffers the call
+// itself allocates. Schedulers use it to admit jobs against a memory budget.
+EMSCRIPTEN_KEEPALIVE
+size_t sc_estimate_bytes(int height, int width, int mode) {
+    size_t pixels = (size_t)height * width;
+    size_t workspace = sc_workspace_bytes(height, width);
+
+    switch (mode) {
+    case SC_MODE_STRIPS:
+        // The strip contexts together hold about another working set
+        return 2 * workspace + pixels * 4;
+    case SC_MODE_ORDER:
+        // Index plane in the context plus the caller's order array
+        return workspace + 2 * pixels * sizeof(int32_t);
+    default:
+        return workspace + pixels * 4;
+    }
+}
+
+// Grow the default context's working set for a height x width image before
+// carving starts. The heap is first grown in one step to also fit the input
+// and output images, so that neither the working set nor the caller's image
+// buffers grow memory (which in WASM invalidates every view of the heap)
+// while a carve is running. Returns 0, or -1 when out of memory.
+EMSCRIPTEN_KEEPALIVE
+int sc_reserve(int height, int width) {
+    size_t pixels = (size_t)height * width;
+    void *block = malloc(sc_workspace_bytes(height, width) + 2 * pixels * 4);
+    if (!block) {
+        return -1;
+    }
+    free(block);
+
+    int ok = ctx_buffer(&default_ctx, SLOT_WORK, pixels * 4) &&
+             ctx_buffer(&default_ctx, SLOT_ENERGY, pixels * 4) &&
+             ctx_buffer(&default_ctx, SLOT_COST, pixels * sizeof(double)) &&
+             ctx_buffer(&default_ctx, SLOT_PATH, height * sizeof(int)) &&
+             ctx_buffer(&default_ctx, SLOT_LO, height * sizeof(int)) &&
+             ctx_buffer(&default_ctx, SLOT_HI, height * sizeof(int));
+    return ok ? 0 : -1;
+}
+
+// Release the default context's working set
+EMSCRIPTEN_KEEPALIVE
+void sc_reset(void) {
+    sc_context_reset(&default_ctx);
+}
+
+// Cap the default context's working set at `bytes` (0 for no cap); carves
+// that would need more use smaller, slower DP tables instead
+EMSCRIPTEN_KEEPALIVE
+void sc_set_memory_limit(size_t bytes) {
+    default_ctx.memory_limit = bytes;
+}
+
+void sc_set_tuning(const sc_tuning *t) {
+    tuning = *t;
+}
+
+void sc_get_tuning(sc_tuning *t) {
+    *t = tuning;
+}
+
 // Function to be exposed to JavaScript
 EMSCRIPTEN_KEEPALIVE
 uint8_t *create_image(int height, int width) {
@@ -45,63 +266,63 @@ static inline double min_3(double e1, double e2, double e3) {
     return (sub_min > e3) ? e3 : sub_min;
 }
 
+// Dual-gradient energy of a single pixel, wrapping around at the edges of a
+// w pixel wide image whose rows are `stride` pixels apart
+static inline int pixel_energy_at(uint8_t *src, int stride, int w, int h, int j, int i) {
+    int k_left = (i == 0) ? w - 1 : i - 1;
+    int k_right = (i == w - 1) ? 0 : i + 1;
+    int k_up = (j == 0) ? h - 1 : j - 1;
+    int k_down = (j == h - 1) ? 0 : j + 1;
+
+    // Calculate gradient in x direction
+    int r_x = get_pixel(src, stride, j, k_right, 0) - get_pixel(src, stride, j, k_left, 0);
+    int g_x = get_pixel(src, stride, j, k_right, 1) - get_pixel(src, stride, j, k_left, 1);
+    int b_x = get_pixel(src, stride, j, k_right, 2) - get_pixel(src, stride, j, k_left, 2);
+
+    // Calculate gradient in y direction
+    int r_y = get_pixel(src, stride, k_up, i, 0) - get_pixel(src, stride, k_down, i, 0);
+    int g_y = get_pixel(src, stride, k_up, i, 1) - get_pixel(src, stride, k_down, i, 1);
+    int b_y = get_pixel(src, stride, k_up, i, 2) - get_pixel(src, stride, k_down, i, 2);
+
+    // Calculate energy
+    int grad_x_2 = r_x * r_x + g_x * g_x + b_x * b_x;
+    int grad_y_2 = r_y * r_y + g_y * g_y + b_y * b_y;
+
+    int energy = sqrt(grad_x_2 + grad_y_2);
+    return energy / 10;
+}
+
+// Dual-gradient energy of a single pixel of a w pixel wide image
+static inline int pixel_energy(uint8_t *src, int w, int h, int j, int i) {
+    return pixel_energy_at(src, w, w, h, j, i);
+}
+
 // Calculate the energy map for an image
 EMSCRIPTEN_KEEPALIVE
 void calc_energy(uint8_t *src, uint8_t *dest, int height, int width) {
-    int w = width;
-    int h = height;
-    
-    for (int j = 0; j < h; j++) {
-        for (int i = 0; i < w; i++) {
-            int k_left = (i == 0) ? w - 1 : i - 1;
-            int k_right = (i == w - 1) ? 0 : i + 1;
-            int k_up = (j == 0) ? h - 1 : j - 1;
-            int k_down = (j == h - 1) ? 0 : j + 1;
-            
-            // Calculate gradient in x direction
-            int r_x = get_pixel(src, w, j, k_right, 0) - get_pixel(src, w, j, k_left, 0);
-            int g_x = get_pixel(src, w, j, k_right, 1) - get_pixel(src, w, j, k_left, 1);
-            int b_x = get_pixel(src, w, j, k_right, 2) - get_pixel(src, w, j, k_left, 2);
-            
-            // Calculate gradient in y direction
-            int r_y = get_pixel(src, w, k_up, i, 0) - get_pixel(src, w, k_down, i, 0);
-            int g_y = get_pixel(src, w, k_up, i, 1) - get_pixel(src, w, k_down, i, 1);
-            int b_y = get_pixel(src, w, k_up, i, 2) - get_pixel(src, w, k_down, i, 2);
-            
-            // Calculate energy
-            int grad_x_2 = r_x * r_x + g_x * g_x + b_x * b_x;
-            int grad_y_2 = r_y * r_y + g_y * g_y + b_y * b_y;
-            
-            int energy = sqrt(grad_x_2 + grad_y_2);
-            int energy_norm = energy / 10;
-            
+    for (int j = 0; j < height; j++) {
+        for (int i = 0; i < width; i++) {
+            int energy_norm = pixel_energy(src, width, height, j, i);
+
             // Store energy as grayscale
-            set_pixel(dest, w, j, i, energy_norm, energy_norm, energy_norm, 255);
+            set_pixel(dest, width, j, i, energy_norm, energy_norm, energy_norm, 255);
         }
     }
 }
 
-// Main seam carving function that performs all steps
-EMSCRIPTEN_KEEPALIVE
-uint8_t *seam_carve(uint8_t *src, int height, int width) {
-    // Create an energy map
-    uint8_t *energy_map = (uint8_t *)malloc(height * width * 4);
-    calc_energy(src, energy_map, height, width);
-    
-    // Create an array to store the cumulative minimum energy
-    double *best_arr = (double *)malloc(height * width * sizeof(double));
-    
+// Fill the cumulative minimum energy table from an energy map
+static void fill_cost(uint8_t *energy_map, double *best_arr, int height, int width) {
     // Initialize the first row with the energy values
     for (int i = 0; i < width; i++) {
         best_arr[i] = get_pixel(energy_map, width, 0, i, 0);
     }
-    
+
     // Fill in the rest of the DP table
     for (int j = 1; j < height; j++) {
         for (int i = 0; i < width; i++) {
             double cur = get_pixel(energy_map, width, j, i, 0);
             double min;
-            
+
             if (i == 0) {
                 // Leftmost column
                 double e1 = best_arr[(j - 1) * width + i + 1];
@@ -121,73 +342,2230 @@ uint8_t *seam_carve(uint8_t *src, int height, int width) {
                 double e3 = best_arr[(j - 1) * width + i + 1];
                 min = min_3(e1, e2, e3);
             }
-            
+
             best_arr[j * width + i] = cur + min;
         }
     }
-    
-    // Find the seam path
-    int *path = (int *)malloc(height * sizeof(int));
-    
+}
+
+// Backtrack the minimum seam through a full DP table whose rows are `stride`
+// doubles apart, returning its cost
+static double find_seam(double *best_arr, int height, int width, int stride, int *path) {
     // Find the minimum energy value in the last row
-    double min_energy = best_arr[(height - 1) * width];
+    double min_energy = best_arr[(height - 1) * stride];
     int min_idx = 0;
-    
+
     for (int i = 1; i < width; i++) {
-        if (best_arr[(height - 1) * width + i] < min_energy) {
-            min_energy = best_arr[(height - 1) * width + i];
+        if (best_arr[(height - 1) * stride + i] < min_energy) {
+            min_energy = best_arr[(height - 1) * stride + i];
             min_idx = i;
         }
     }
     path[height - 1] = min_idx;
-    
+    double seam_cost = min_energy;
+
     // Backtrack to find the path
     for (int j = height - 2; j >= 0; j--) {
         int prev_idx = path[j + 1];
         min_idx = prev_idx;
-        min_energy = best_arr[j * width + prev_idx];
-        
+        min_energy = best_arr[j * stride + prev_idx];
+
         if (prev_idx > 0) {
-            if (best_arr[j * width + prev_idx - 1] < min_energy) {
-                min_energy = best_arr[j * width + prev_idx - 1];
+            if (best_arr[j * stride + prev_idx - 1] < min_energy) {
+                min_energy = best_arr[j * stride + prev_idx - 1];
                 min_idx = prev_idx - 1;
             }
         }
-        
+
         if (prev_idx < width - 1) {
-            if (best_arr[j * width + prev_idx + 1] < min_energy) {
-                min_energy = best_arr[j * width + prev_idx + 1];
+            if (best_arr[j * stride + prev_idx + 1] < min_energy) {
+                min_energy = best_arr[j * stride + prev_idx + 1];
                 min_idx = prev_idx + 1;
             }
         }
-        
+
         path[j] = min_idx;
     }
-    
-    // Create the output image with one less column
-    uint8_t *output = (uint8_t *)malloc(height * (width - 1) * 4);
-    
-    // Copy pixels, skipping the seam
+
+    return seam_cost;
+}
+
+// Restrict the seam search of every row to a window of columns. Without a
+// previous seam the window spans the whole row; otherwise it is +/- margin
+// columns around the previous seam. Either way the pad outermost columns on
+// each side are excluded.
+static void set_window(int *lo, int *hi, int height, int width, int *prev_path, int margin, int pad) {
     for (int j = 0; j < height; j++) {
-        int new_col = 0;
-        for (int i = 0; i < width; i++) {
-            if (i != path[j]) {
-                set_pixel(output, width - 1, j, new_col, 
-                         get_pixel(src, width, j, i, 0),
-                         get_pixel(src, width, j, i, 1),
-                         get_pixel(src, width, j, i, 2),
-                         get_pixel(src, width, j, i, 3));
-                new_col++;
-            }
-        }
-    }
-    
-    // Free allocated memory
-    free(energy_map);
-    free(best_arr);
-    free(path);
-    
-    return output;
+        lo[j] = pad;
+        hi[j] = width - 1 - pad;
+
+        if (prev_path) {
+            // The previous seam was found one column wider, so clamp it
+            int center = (prev_path[j] > width - 1) ? width - 1 : prev_path[j];
+            if (center - margin > lo[j]) {
+                lo[j] = center - margin;
+            }
+            if (center + margin < hi[j]) {
+                hi[j] = center + margin;
+            }
+        }
+    }
+}
+
+// Fill the DP table only inside the per-row windows lo/hi. Energy is computed
+// on the fly for the window cells, so the work per seam is proportional to the
+// window rather than the width.
+static void fill_cost_window(uint8_t *src, double *best_arr, int *lo, int *hi, int height, int width) {
+    for (int i = lo[0]; i <= hi[0]; i++) {
+        best_arr[i] = pixel_energy(src, width, height, 0, i);
+    }
+
+    for (int j = 1; j < height; j++) {
+        for (int i = lo[j]; i <= hi[j]; i++) {
+            // Only neighbours inside the previous row's window are valid
+            int k_from = (i - 1 < lo[j - 1]) ? lo[j - 1] : i - 1;
+            int k_to = (i + 1 > hi[j - 1]) ? hi[j - 1] : i + 1;
+            double min = INFINITY;
+
+            for (int k = k_from; k <= k_to; k++) {
+                min = min_2(min, best_arr[(j - 1) * width + k]);
+            }
+
+            best_arr[j * width + i] = pixel_energy(src, width, height, j, i) + min;
+        }
+    }
+}
+
+// Fill DP cells [i0, i1) of row j of a full table whose rows, like those of
+// src, are `stride` apart, with energy on the fly. Same values as fill_cost.
+static inline void fill_cost_span(uint8_t *src, double *best_arr, int stride, int height,
+                                  int width, int j, int i0, int i1) {
+    double *row = best_arr + (size_t)j * stride;
+
+    if (j == 0) {
+        for (int i = i0; i < i1; i++) {
+            row[i] = pixel_energy_at(src, stride, width, height, 0, i);
+        }
+        return;
+    }
+    const double *up = row - stride;
+    for (int i = i0; i < i1; i++) {
+        double min = up[i];
+        if (i > 0) {
+            min = min_2(min, up[i - 1]);
+        }
+        if (i < width - 1) {
+            min = min_2(min, up[i + 1]);
+        }
+        row[i] = pixel_energy_at(src, stride, width, height, j, i) + min;
+    }
+}
+
+// Backtrack the minimum seam through a windowed DP table, returning its cost
+static double find_seam_window(double *best_arr, int *lo, int *hi, int height, int width, int *path) {
+    double min_energy = INFINITY;
+    int min_idx = lo[height - 1];
+
+    for (int i = lo[height - 1]; i <= hi[height - 1]; i++) {
+        if (best_arr[(height - 1) * width + i] < min_energy) {
+            min_energy = best_arr[(height - 1) * width + i];
+            min_idx = i;
+        }
+    }
+    path[height - 1] = min_idx;
+    double seam_cost = min_energy;
+
+    for (int j = height - 2; j >= 0; j--) {
+        int prev_idx = path[j + 1];
+        min_idx = -1;
+        min_energy = INFINITY;
+
+        // Same tie-breaking order as find_seam: straight up, left, right
+        int candidates[3] = { prev_idx, prev_idx - 1, prev_idx + 1 };
+        for (int c = 0; c < 3; c++) {
+            int k = candidates[c];
+            if (k < lo[j] || k > hi[j]) {
+                continue;
+            }
+            if (min_idx < 0 || best_arr[j * width + k] < min_energy) {
+                min_energy = best_arr[j * width + k];
+                min_idx = k;
+            }
+        }
+
+        path[j] = min_idx;
+    }
+
+    return seam_cost;
+}
+
+// Step of a seam from one row to the row above, as kept in a step bitmap
+enum { STEP_UP, STEP_LEFT, STEP_RIGHT, STEP_NONE };
+
+static inline void set_step(uint8_t *steps, size_t k, int step) {
+    int shift = 2 * (k & 3);
+    steps[k >> 2] = (uint8_t)((steps[k >> 2] & ~(3 << shift)) | (step << shift));
+}
+
+static inline int get_step(const uint8_t *steps, size_t k) {
+    return (steps[k >> 2] >> (2 * (k & 3))) & 3;
+}
+
+// Find the minimum seam within the per-row windows lo/hi keeping only two
+// rows of costs and a 2-bit step per cell, `stride` cells per row. Steps are
+// chosen with find_seam's tie-breaking, so this finds the same seam as
+// fill_cost_window and find_seam_window in a fraction of the memory.
+// Returns the seam's cost.
+static double find_seam_steps(uint8_t *src, int *lo, int *hi, int height, int width, int stride,
+                              double *rows, uint8_t *steps, int *path) {
+    double *prev = rows;
+    double *cur = rows + stride;
+
+    for (int i = lo[0]; i <= hi[0]; i++) {
+        prev[i - lo[0]] = pixel_energy(src, width, height, 0, i);
+    }
+
+    for (int j = 1; j < height; j++) {
+        for (int i = lo[j]; i <= hi[j]; i++) {
+            // Straight up, left, right, in the order of STEP_*
+            int candidates[3] = { i, i - 1, i + 1 };
+            double min = INFINITY;
+            int step = STEP_NONE;
+
+            for (int c = 0; c < 3; c++) {
+                int k = candidates[c];
+                if (k < lo[j - 1] || k > hi[j - 1]) {
+                    continue;
+                }
+                if (step == STEP_NONE || prev[k - lo[j - 1]] < min) {
+                    min = prev[k - lo[j - 1]];
+                    step = c;
+                }
+            }
+
+            cur[i - lo[j]] = pixel_energy(src, width, height, j, i) + min;
+            set_step(steps, (size_t)j * stride + i - lo[j], step);
+        }
+
+        double *t = prev;
+        prev = cur;
+        cur = t;
+    }
+
+    double min_energy = INFINITY;
+    int min_idx = lo[height - 1];
+    for (int i = lo[height - 1]; i <= hi[height - 1]; i++) {
+        if (prev[i - lo[height - 1]] < min_energy) {
+            min_energy = prev[i - lo[height - 1]];
+            min_idx = i;
+        }
+    }
+    path[height - 1] = min_idx;
+
+    for (int j = height - 1; j > 0; j--) {
+        int step = get_step(steps, (size_t)j * stride + path[j] - lo[j]);
+        path[j - 1] = path[j] + (step == STEP_LEFT ? -1 : step == STEP_RIGHT ? 1 : 0);
+    }
+
+    return min_energy;
+}
+
+// Row j of the exact DP over columns c0..c1 from row j - 1 (prev, NULL for
+// the first row). Rows are indexed by column.
+static void fill_cost_row(uint8_t *src, int height, int width, int c0, int c1, const double *prev,
+                          int j, double *out) {
+    for (int i = c0; i <= c1; i++) {
+        double min = 0;
+
+        if (prev) {
+            min = prev[i];
+            if (i > c0) {
+                min = min_2(min, prev[i - 1]);
+            }
+            if (i < c1) {
+                min = min_2(min, prev[i + 1]);
+            }
+        }
+        out[i] = pixel_energy(src, width, height, j, i) + min;
+    }
+}
+
+// Helper function for find_seam_linear to fill in path[lo..hi - 1] from
+// path[hi] and the costs of row lo, with room for `rows` more cost rows in
+// scratch. A segment that fits is recomputed whole and backtracked like
+// find_seam; a longer one is split at its middle row, which is recomputed
+// and kept while the half below it is done first.
+static void backtrack_linear(uint8_t *src, int height, int width, int c0, int c1,
+                             const double *row_lo, int lo, int hi, double *scratch, int rows,
+                             int *path) {
+    if (hi - lo <= rows) {
+        memcpy(scratch, row_lo, width * sizeof(double));
+        for (int j = lo + 1; j < hi; j++) {
+            fill_cost_row(src, height, width, c0, c1, scratch + (size_t)(j - 1 - lo) * width, j,
+                          scratch + (size_t)(j - lo) * width);
+        }
+        for (int j = hi - 1; j >= lo; j--) {
+            const double *row = scratch + (size_t)(j - lo) * width;
+            int next = path[j + 1];
+            int min_idx = next;
+
+            if (next > c0 && row[next - 1] < row[min_idx]) {
+                min_idx = next - 1;
+            }
+            if (next < c1 && row[next + 1] < row[min_idx]) {
+                min_idx = next + 1;
+            }
+            path[j] = min_idx;
+        }
+        return;
+    }
+
+    int mid = lo + (hi - lo) / 2;
+    const double *prev = row_lo;
+    for (int j = lo + 1; j <= mid; j++) {
+        double *out = (prev == scratch) ? scratch + width : scratch;
+        fill_cost_row(src, height, width, c0, c1, prev, j, out);
+        prev = out;
+    }
+    if (prev != scratch) {
+        memcpy(scratch, prev, width * sizeof(double));
+    }
+
+    backtrack_linear(src, height, width, c0, c1, scratch, mid, hi, scratch + width, rows - 1,
+                     path);
+    backtrack_linear(src, height, width, c0, c1, row_lo, lo, mid, scratch, rows, path);
+}
+
+// Cost rows find_seam_linear needs at the least for a given height
+static int linear_min_rows(int height) {
+    int rows = 2;
+    while ((1 << (rows - 2)) < height) {
+        rows++;
+    }
+    return rows;
+}
+
+// Find the minimum seam between columns c0 and c1 with 1 + rows cost rows of
+// `width` doubles in buf, rows >= linear_min_rows(height). Rows are
+// recomputed while backtracking, about log2(height / rows) times over, and
+// the seam is the one find_seam finds. Returns its cost.
+static double find_seam_linear(uint8_t *src, int height, int width, int c0, int c1, double *buf,
+                               int rows, int *path) {
+    double *row0 = buf;
+    double *scratch = buf + width;
+
+    fill_cost_row(src, height, width, c0, c1, NULL, 0, row0);
+    const double *prev = row0;
+    for (int j = 1; j < height; j++) {
+        double *out = (prev == scratch) ? scratch + width : scratch;
+        fill_cost_row(src, height, width, c0, c1, prev, j, out);
+        prev = out;
+    }
+
+    double min_energy = prev[c0];
+    int min_idx = c0;
+    for (int i = c0 + 1; i <= c1; i++) {
+        if (prev[i] < min_energy) {
+            min_energy = prev[i];
+            min_idx = i;
+        }
+    }
+    path[height - 1] = min_idx;
+
+    if (height > 1) {
+        backtrack_linear(src, height, width, c0, c1, row0, 0, height - 1, scratch, rows, path);
+    }
+    return min_energy;
+}
+
+// Remove the seam without a second buffer. Rows only ever move towards the
+// start of the raster, so compacting top-down never overwrites unread pixels.
+static void remove_seam_in_place(uint8_t *raster, int height, int width, int *path) {
+    for (int j = 0; j < height; j++) {
+        uint8_t *src_row = raster + 4 * j * width;
+        uint8_t *dest_row = raster + 4 * j * (width - 1);
+        int seam = path[j];
+
+        memmove(dest_row, src_row, 4 * seam);
+        memmove(dest_row + 4 * seam, src_row + 4 * (seam + 1), 4 * (width - 1 - seam));
+    }
+}
+
+// Main seam carving function that performs all steps
+EMSCRIPTEN_KEEPALIVE
+uint8_t *seam_carve(uint8_t *src, int height, int width) {
+    return carve_seams_ctx(&default_ctx, src, height, width, 1, 0, 0);
+}
+
+// Where carve_in_place records the seams it removes: index holds the
+// original column of every pixel of the work image and is carved with it.
+// Either record may be left NULL.
+typedef struct {
+    int32_t *index;
+    int32_t *starts;    // original column of each seam in row 0
+    int16_t *steps;     // height - 1 column steps per seam, row to row
+    int32_t *order;     // seam number that removed each original pixel
+    int orig_width;
+} seam_log;
+
+// Helper function to record a seam in original-image coordinates
+static void log_seam(seam_log *log, int s, int height, int width, int *path) {
+    if (log->starts) {
+        int16_t *steps = log->steps + (long)s * (height - 1);
+        int prev = log->index[path[0]];
+
+        log->starts[s] = prev;
+        for (int j = 1; j < height; j++) {
+            int col = log->index[j * width + path[j]];
+            steps[j - 1] = (int16_t)(col - prev);
+            prev = col;
+        }
+    }
+    if (log->order) {
+        for (int j = 0; j < height; j++) {
+            log->order[(long)j * log->orig_width + log->index[j * width + path[j]]] = s;
+        }
+    }
+}
+
+// Helper function to remove the seam pixel at column seam from row j of a
+// work image (and its log index) whose rows are `stride` apart
+static inline void remove_from_row(uint8_t *work, seam_log *log, int stride, int width, int j,
+                                   int seam) {
+    uint8_t *row = work + 4 * (size_t)j * stride;
+    memmove(row + 4 * seam, row + 4 * (seam + 1), 4 * (width - 1 - seam));
+    if (log) {
+        int32_t *index = log->index + (size_t)j * stride;
+        memmove(index + seam, index + seam + 1, sizeof(int32_t) * (width - 1 - seam));
+    }
+}
+
+// Pack the rows of a work image carved at a fixed stride to new_width,
+// top-down as in remove_seam_in_place
+static void pack_rows(uint8_t *work, seam_log *log, int height, int stride, int new_width) {
+    for (int j = 1; j < height; j++) {
+        memmove(work + 4 * (size_t)j * new_width, work + 4 * (size_t)j * stride, 4 * new_width);
+        if (log) {
+            memmove(log->index + (size_t)j * new_width, log->index + (size_t)j * stride,
+                    sizeof(int32_t) * new_width);
+        }
+    }
+}
+
+#ifdef SC_THREADS
+// A parallel exact carve splits every seam across a pool of threads: the DP
+// by column blocks, a chunk of rows at a time (carve_parallel_task), and the
+// seam removal by rows. That synchronizes dozens of times per seam, a few
+// microseconds apart, so waiting threads spin before they sleep on a futex,
+// and a carve forks and joins the pool once rather than once per phase.
+
+static inline void cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ volatile("yield");
+#endif
+}
+
+// Sleep while *addr holds value
+static void futex_wait(atomic_int *addr, int value) {
+#if defined(__linux__)
+    syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, value, NULL, NULL, 0);
+#elif defined(__EMSCRIPTEN__)
+    emscripten_futex_wait((volatile void *)addr, (uint32_t)value, INFINITY);
+#else
+    (void)addr;
+    (void)value;
+    sched_yield();
+#endif
+}
+
+static void futex_wake_all(atomic_int *addr) {
+#if defined(__linux__)
+    syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+#elif defined(__EMSCRIPTEN__)
+    emscripten_futex_wake((volatile void *)addr, INT_MAX);
+#else
+    (void)addr;
+#endif
+}
+
+// Wait for *addr to change from value: spin first, then sleep. sleepers
+// counts the threads asleep on addr so that bump_and_wake only makes the
+// system call when someone needs it.
+static void wait_change(atomic_int *addr, int value, atomic_int *sleepers) {
+    for (int spin = 0; spin < BARRIER_SPINS; spin++) {
+        if (atomic_load_explicit(addr, memory_order_acquire) != value) {
+            return;
+        }
+        cpu_relax();
+    }
+    atomic_fetch_add(sleepers, 1);
+    while (atomic_load(addr) == value) {
+        futex_wait(addr, value);
+    }
+    atomic_fetch_sub(sleepers, 1);
+}
+
+static void bump_and_wake(atomic_int *addr, atomic_int *sleepers) {
+    atomic_fetch_add(addr, 1);
+    if (atomic_load(sleepers) > 0) {
+        futex_wake_all(addr);
+    }
+}
+
+typedef struct {
+    atomic_int arrived;
+    atomic_int generation;    // bumped by the last thread to arrive
+    atomic_int sleepers;
+    int count;
+} sc_barrier;
+
+static void barrier_wait(sc_barrier *b) {
+    int generation = atomic_load_explicit(&b->generation, memory_order_acquire);
+
+    if (atomic_fetch_add_explicit(&b->arrived, 1, memory_order_acq_rel) == b->count - 1) {
+        atomic_store_explicit(&b->arrived, 0, memory_order_relaxed);
+        bump_and_wake(&b->generation, &b->sleepers);
+    }
+    else {
+        wait_change(&b->generation, generation, &b->sleepers);
+    }
+}
+
+// Fork-join pool shared by every context. One carve at a time holds it; a
+// carve that finds it busy runs on its own thread instead.
+typedef struct {
+    int threads;              // pool threads, counting the one that runs a job
+    sc_barrier phase;         // between the phases of a job, for its workers
+    sc_barrier done;          // end of a job, for every pool thread
+    atomic_int job;           // bumped to start a job
+    atomic_int job_sleepers;
+    atomic_int busy;
+    void (*task)(void *arg, int worker, int workers);
+    void *arg;
+    int workers;              // threads of the current job
+    int first_job;            // job count when the newest threads were created
+} sc_pool;
+
+static sc_pool pool;
+
+static void *pool_thread(void *arg) {
+    int worker = (int)(intptr_t)arg;
+    // The job that created this thread cannot finish without it, so
+    // first_job is still that job's count here
+    int seen = pool.first_job;
+
+    for (;;) {
+        wait_change(&pool.job, seen, &pool.job_sleepers);
+        seen = atomic_load_explicit(&pool.job, memory_order_acquire);
+        if (worker < pool.workers) {
+            pool.task(pool.arg, worker, pool.workers);
+        }
+        // Every pool thread passes this before the next job can start, so
+        // none of them misses one
+        barrier_wait(&pool.done);
+    }
+    return NULL;
+}
+
+// Run task on `workers` threads, the caller being worker 0, and return when
+// all of them are done. Workers synchronize with barrier_wait(&pool.phase).
+// Returns 0, or -1 if the pool is busy with another carve.
+static int pool_run(int workers, void (*task)(void *, int, int), void *arg) {
+    if (atomic_exchange(&pool.busy, 1)) {
+        return -1;
+    }
+    // Grow the pool to the tuned size; its threads live as long as the process
+    pool.first_job = atomic_load(&pool.job);
+    while (pool.threads < tuning.dp_threads) {
+        pthread_t id;
+        int worker = (pool.threads == 0) ? 1 : pool.threads;
+        if (pthread_create(&id, NULL, pool_thread, (void *)(intptr_t)worker) != 0) {
+            break;
+        }
+        pthread_detach(id);
+        pool.threads = worker + 1;
+    }
+    if (workers > pool.threads) {
+        workers = pool.threads;
+    }
+    if (workers < 2) {
+        atomic_store(&pool.busy, 0);
+        return -1;
+    }
+
+    pool.task = task;
+    pool.arg = arg;
+    pool.workers = workers;
+    pool.phase.count = workers;
+    pool.done.count = pool.threads;
+    bump_and_wake(&pool.job, &pool.job_sleepers);
+
+    task(arg, 0, workers);
+    barrier_wait(&pool.done);
+    atomic_store(&pool.busy, 0);
+    return 0;
+}
+
+// Threads worth sharing the DP of an exact seam of a height x width image:
+// one per parallel_pixels, with column blocks at least two chunks wide
+static int dp_workers(int height, int width) {
+    if (tuning.dp_threads <= 1 || tuning.parallel_pixels <= 0) {
+        return 1;
+    }
+    double by_size = (double)height * width / tuning.parallel_pixels;
+    int workers = (by_size < tuning.dp_threads) ? (int)by_size : tuning.dp_threads;
+    if (workers > width / (4 * DP_CHUNK_ROWS)) {
+        workers = width / (4 * DP_CHUNK_ROWS);
+    }
+    return (workers > 1) ? workers : 1;
+}
+
+typedef struct {
+    uint8_t *work;
+    double *best_arr;
+    int *paths;               // a path per worker; worker 0's is the context's
+    int height;
+    int stride;               // row length of work and best_arr: the start width
+    int num_seams;
+    seam_log *log;
+    double cost;              // of the last seam
+} parallel_carve;
+
+// One worker of a parallel exact carve. Rows keep the start width as their
+// stride, so removing a seam only moves pixels within rows and the rows can
+// be shared out; carve_parallel packs them once at the end.
+//
+// The DP goes a chunk of rows at a time. Each worker first fills a trapezoid
+// of its column block that narrows by one column per row on every side that
+// has a neighbour, so it only reads cells of its own block. After a barrier
+// each worker fills the inverted triangle between its block and the next,
+// whose cells above are now all done. Values and tie-breaking are those of
+// the serial DP, so the seams are identical.
+static void carve_parallel_task(void *arg, int worker, int workers) {
+    parallel_carve *pc = (parallel_carve *)arg;
+    int height = pc->height;
+    int width = pc->stride;
+    int *path = pc->paths + (size_t)worker * height;
+    int row_lo = (int)((long)height * worker / workers);
+    int row_hi = (int)((long)height * (worker + 1) / workers);
+
+    for (int s = 0; s < pc->num_seams; s++, width--) {
+        int c0 = (int)((long)width * worker / workers);
+        int c1 = (int)((long)width * (worker + 1) / workers);
+        int chunk = width / workers / 2;
+        if (chunk > DP_CHUNK_ROWS) {
+            chunk = DP_CHUNK_ROWS;
+        }
+        else if (chunk < 1) {
+            chunk = 1;
+        }
+
+        for (int j0 = 0; j0 < height; j0 += chunk) {
+            int rows = (height - j0 < chunk) ? height - j0 : chunk;
+
+            for (int r = 0; r < rows; r++) {
+                int lo = (worker > 0) ? c0 + r : 0;
+                int hi = (worker < workers - 1) ? c1 - r : width;
+                fill_cost_span(pc->work, pc->best_arr, pc->stride, height, width, j0 + r, lo, hi);
+            }
+            barrier_wait(&pool.phase);
+
+            if (worker < workers - 1) {
+                for (int r = 1; r < rows; r++) {
+                    fill_cost_span(pc->work, pc->best_arr, pc->stride, height, width, j0 + r,
+                                   c1 - r, c1 + r);
+                }
+            }
+            barrier_wait(&pool.phase);
+        }
+
+        // Every worker backtracks the seam itself, which is cheaper than
+        // waiting for one to share it
+        double cost = find_seam(pc->best_arr, height, width, pc->stride, path);
+        if (pc->log) {
+            if (worker == 0) {
+                log_seam(pc->log, s, height, pc->stride, path);
+            }
+            barrier_wait(&pool.phase);
+        }
+
+        for (int j = row_lo; j < row_hi; j++) {
+            remove_from_row(pc->work, pc->log, pc->stride, width, j, path[j]);
+        }
+        if (worker == 0) {
+            pc->cost = cost;
+        }
+        barrier_wait(&pool.phase);
+    }
+}
+
+// Carve num_seams exact seams out of work on `workers` pool threads with the
+// DP in best_arr. Returns the new width, or -1 if the pool is busy.
+static int carve_parallel(sc_context *ctx, uint8_t *work, double *best_arr, int height, int width,
+                          int num_seams, int workers, seam_log *log, sc_progress *progress) {
+    int *paths = (int *)ctx_buffer(ctx, SLOT_PATH, (size_t)workers * height * sizeof(int));
+    parallel_carve pc = { work, best_arr, paths, height, width, num_seams, log, 0 };
+
+    if (pool_run(workers, carve_parallel_task, &pc) != 0) {
+        return -1;
+    }
+
+    int new_width = width - num_seams;
+    pack_rows(work, log, height, width, new_width);
+    progress->seams += num_seams;
+    progress->since_exact = 0;
+    progress->exact_cost = pc.cost;
+    ctx->table_seams[SC_TABLE_FULL] += num_seams;
+    return new_width;
+}
+#endif
+
+// A pipelined exact carve removes seam s and runs the DP of seam s + 1 in
+// one sweep down the rows: row j of the DP needs the energy of rows j - 1 to
+// j + 1, so it can follow two rows behind the removal instead of waiting for
+// a whole pass. Rows keep the start width as their stride, which lets the
+// removal go in any row order: the bottom row first, because the energy of
+// row 0 wraps around to it, then top-down.
+typedef struct {
+    uint8_t *work;
+    double *best_arr;
+    int *energy_row;
+    int *path;
+    int height;
+    int stride;
+    int num_seams;
+    seam_log *log;
+    double cost;              // of the last seam
+#ifdef SC_THREADS
+    atomic_int found;         // seams whose path is ready for removal
+    atomic_int removed;       // rows removed, over all seams
+    atomic_int found_sleepers;
+    atomic_int removed_sleepers;
+#endif
+} pipeline_carve;
+
+// Helper function for pipeline_dp: DP row j of the full table, with the
+// energy of the row computed into erow first. Both loops are free of the
+// wrap-around tests of the edge columns, so they vectorize.
+static void pipeline_fill_row(uint8_t *src, double *best_arr, int *erow, int stride, int height,
+                              int width, int j) {
+    const uint8_t *row = src + 4 * (size_t)j * stride;
+    const uint8_t *up = src + 4 * (size_t)((j == 0) ? height - 1 : j - 1) * stride;
+    const uint8_t *down = src + 4 * (size_t)((j == height - 1) ? 0 : j + 1) * stride;
+
+    erow[0] = pixel_energy_at(src, stride, width, height, j, 0);
+    erow[width - 1] = pixel_energy_at(src, stride, width, height, j, width - 1);
+    for (int i = 1; i < width - 1; i++) {
+        int r_x = row[4 * (i + 1) + 0] - row[4 * (i - 1) + 0];
+        int g_x = row[4 * (i + 1) + 1] - row[4 * (i - 1) + 1];
+        int b_x = row[4 * (i + 1) + 2] - row[4 * (i - 1) + 2];
+        int r_y = up[4 * i + 0] - down[4 * i + 0];
+        int g_y = up[4 * i + 1] - down[4 * i + 1];
+        int b_y = up[4 * i + 2] - down[4 * i + 2];
+        int energy = sqrt(r_x * r_x + g_x * g_x + b_x * b_x + r_y * r_y + g_y * g_y + b_y * b_y);
+        erow[i] = energy / 10;
+    }
+
+    double *cost = best_arr + (size_t)j * stride;
+    if (j == 0) {
+        for (int i = 0; i < width; i++) {
+            cost[i] = erow[i];
+        }
+        return;
+    }
+    const double *prev = cost - stride;
+    if (width == 1) {
+        cost[0] = erow[0] + prev[0];
+        return;
+    }
+    cost[0] = erow[0] + min_2(prev[0], prev[1]);
+    for (int i = 1; i < width - 1; i++) {
+        cost[i] = erow[i] + min_3(prev[i - 1], prev[i], prev[i + 1]);
+    }
+    cost[width - 1] = erow[width - 1] + min_2(prev[width - 2], prev[width - 1]);
+}
+
+// Row removed t-th in the pipeline's order
+static inline int pipeline_row(int t, int height) {
+    return (t == 0) ? height - 1 : t - 1;
+}
+
+// Rows of the previous seam that must be gone before DP row j of the next
+static inline int pipeline_need(int j, int height) {
+    return (j + 3 < height) ? j + 3 : height;
+}
+
+// Run the pipeline. With split, the removal is left to a second thread
+// (pipeline_remove) and only waited for.
+static void pipeline_dp(pipeline_carve *pc, int split) {
+    int height = pc->height;
+
+    for (int s = 0; s < pc->num_seams; s++) {
+        int width = pc->stride - s;
+        int removed = 0;
+
+        for (int j = 0; j < height; j++) {
+            int need = (s > 0) ? pipeline_need(j, height) : 0;
+#ifdef SC_THREADS
+            if (split) {
+                int target = (s - 1) * height + need;
+                int seen;
+                while ((seen = atomic_load_explicit(&pc->removed, memory_order_acquire)) <
+                       target) {
+                    wait_change(&pc->removed, seen, &pc->removed_sleepers);
+                }
+                need = 0;
+            }
+#else
+            (void)split;
+#endif
+            for (; removed < need; removed++) {
+                int row = pipeline_row(removed, height);
+                remove_from_row(pc->work, pc->log, pc->stride, width + 1, row, pc->path[row]);
+            }
+            pipeline_fill_row(pc->work, pc->best_arr, pc->energy_row, pc->stride, height, width, j);
+        }
+
+        pc->cost = find_seam(pc->best_arr, height, width, pc->stride, pc->path);
+        if (pc->log) {
+            log_seam(pc->log, s, height, pc->stride, pc->path);
+        }
+#ifdef SC_THREADS
+        if (split) {
+            bump_and_wake(&pc->found, &pc->found_sleepers);
+            continue;
+        }
+#endif
+        if (s == pc->num_seams - 1) {
+            for (int row = 0; row < height; row++) {
+                remove_from_row(pc->work, pc->log, pc->stride, width, row, pc->path[row]);
+            }
+        }
+    }
+}
+
+#ifdef SC_THREADS
+// Removal side of a split pipeline: remove each seam as soon as its path is
+// found, publishing every row so the DP of the next seam can follow
+static void pipeline_remove(pipeline_carve *pc) {
+    int height = pc->height;
+
+    for (int s = 0; s < pc->num_seams; s++) {
+        int seen;
+        while ((seen = atomic_load_explicit(&pc->found, memory_order_acquire)) <= s) {
+            wait_change(&pc->found, seen, &pc->found_sleepers);
+        }
+        int width = pc->stride - s;
+        for (int t = 0; t < height; t++) {
+            int row = pipeline_row(t, height);
+            remove_from_row(pc->work, pc->log, pc->stride, width, row, pc->path[row]);
+            bump_and_wake(&pc->removed, &pc->removed_sleepers);
+        }
+    }
+}
+
+static void pipeline_task(void *arg, int worker, int workers) {
+    (void)workers;
+    if (worker == 0) {
+        pipeline_dp((pipeline_carve *)arg, 1);
+    }
+    else {
+        pipeline_remove((pipeline_carve *)arg);
+    }
+}
+#endif
+
+// How a carve_in_place call keeps its DP in the energy and cost slots
+typedef struct {
+    int table;            // SC_TABLE_*
+    int two_pass;         // full table with a separate energy pass
+    int margin;           // band of banded seams, 0 for none
+    int linear_rows;      // cost rows of SC_TABLE_LINEAR
+    size_t energy_bytes;
+    size_t cost_bytes;
+} dp_storage;
+
+// Choose how to store the DP for a height x width carve: the largest table
+// that fits the context's memory limit next to the other buffers it holds.
+// Outside the full table banded seams keep a step bitmap of their band, and
+// when nothing else fits every seam is banded.
+static void plan_storage(sc_context *ctx, int height, int width, int band_margin, int pad,
+                         dp_storage *st) {
+    size_t pixels = (size_t)height * width;
+    size_t other = ctx->bytes - ctx->caps[SLOT_ENERGY] - ctx->caps[SLOT_COST];
+    size_t room = (ctx->memory_limit > other) ? ctx->memory_limit - other : 0;
+
+    st->table = SC_TABLE_FULL;
+    st->two_pass = pad == 0 && !tuning.fused_energy;
+    st->margin = band_margin;
+    st->linear_rows = 0;
+    st->energy_bytes = st->two_pass ? pixels * 4 : 0;
+    st->cost_bytes = pixels * sizeof(double);
+    if (ctx->memory_limit == 0 || ALIGN_UP(st->energy_bytes) + ALIGN_UP(st->cost_bytes) <= room) {
+        return;
+    }
+    // The fused kernel needs no energy map
+    st->two_pass = 0;
+    st->energy_bytes = 0;
+    if (ALIGN_UP(st->cost_bytes) <= room) {
+        return;
+    }
+
+    size_t band_cells = (size_t)height * (2 * band_margin + 1);
+    size_t band_steps = (band_margin > 0) ? band_cells / 4 + 1 : 0;
+    size_t band_rows = (band_margin > 0) ? 2 * (2 * band_margin + 1) * sizeof(double) : 0;
+    size_t row_bytes = width * sizeof(double);
+
+    st->table = SC_TABLE_BITMAP;
+    st->energy_bytes = (pixels / 4 + 1 > band_steps) ? pixels / 4 + 1 : band_steps;
+    st->cost_bytes = (2 * row_bytes > band_rows) ? 2 * row_bytes : band_rows;
+    if (ALIGN_UP(st->energy_bytes) + ALIGN_UP(st->cost_bytes) <= room) {
+        return;
+    }
+
+    st->table = SC_TABLE_LINEAR;
+    st->energy_bytes = band_steps;
+    size_t used = ALIGN_UP(band_steps) + SC_ALIGN;
+    size_t rows = (room > used) ? (room - used) / row_bytes : 0;
+    rows = (rows > 0) ? rows - 1 : 0;
+    if (rows > (size_t)height) {
+        rows = height;
+    }
+    if (rows >= (size_t)linear_min_rows(height)) {
+        st->linear_rows = (int)rows;
+        st->cost_bytes = ((1 + rows) * row_bytes > band_rows) ? (1 + rows) * row_bytes : band_rows;
+        return;
+    }
+
+    st->table = SC_TABLE_BAND;
+    if (st->margin == 0) {
+        st->margin = FAST_BAND_MARGIN;
+    }
+    st->energy_bytes = (size_t)height * (2 * st->margin + 1) / 4 + 1;
+    st->cost_bytes = 2 * (2 * st->margin + 1) * sizeof(double);
+}
+
+// Carve num_seams exact seams out of work through the pipeline, with the DP
+// in best_arr. Returns the new width.
+static int carve_pipelined(sc_context *ctx, uint8_t *work, double *best_arr, int height,
+                           int width, int num_seams, seam_log *log, sc_progress *progress) {
+    int *path = (int *)ctx_buffer(ctx, SLOT_PATH, height * sizeof(int));
+    pipeline_carve pc;
+    memset(&pc, 0, sizeof(pc));
+    pc.work = work;
+    pc.best_arr = best_arr;
+    pc.energy_row = (int *)ctx_buffer(ctx, SLOT_ENERGY, width * sizeof(int));
+    pc.path = path;
+    pc.height = height;
+    pc.stride = width;
+    pc.num_seams = num_seams;
+    pc.log = log;
+
+#ifdef SC_THREADS
+    if (tuning.pipeline != SC_PIPELINE_SPLIT || pool_run(2, pipeline_task, &pc) != 0) {
+        pipeline_dp(&pc, 0);
+    }
+#else
+    pipeline_dp(&pc, 0);
+#endif
+
+    int new_width = width - num_seams;
+    pack_rows(work, log, height, width, new_width);
+    progress->seams += num_seams;
+    progress->since_exact = 0;
+    progress->exact_cost = pc.cost;
+    ctx->table_seams[SC_TABLE_FULL] += num_seams;
+    return new_width;
+}
+
+// Carve num_seams seams out of work in place, never touching the pad
+// outermost columns on each side. Returns the new width. When log is not
+// NULL every removed seam is recorded in it. progress, if not NULL, carries
+// the band state over from an earlier call on the same work image.
+//
+// With band_margin > 0 each seam after the first is searched only within
+// band_margin columns of the previous seam. A full DP is run every
+// refresh_interval seams (0 disables the periodic refresh) and whenever a
+// banded seam costs more than BAND_DRIFT_TOLERANCE times the last exact seam,
+// which corrects drift away from the true optimum.
+//
+// A context with a memory limit stores the DP in the largest table that
+// fits (plan_storage). Down to SC_TABLE_LINEAR the seams are the same, only
+// slower. SC_TABLE_BAND bands every seam, around the middle column for the
+// first one, and keeps banded seams however far they drift.
+//
+// Exact full-table carves go through the pipeline (carve_pipelined) unless
+// tuning turns it off, or are shared across threads (carve_parallel) when
+// the image is large enough.
+static int carve_in_place(sc_context *ctx, uint8_t *work, int height, int width, int num_seams,
+                          int band_margin, int refresh_interval, int pad, seam_log *log,
+                          sc_progress *progress) {
+    sc_progress fresh = {0, 0, 0};
+    if (!progress) {
+        progress = &fresh;
+    }
+    if (band_margin == 0 && pad == 0 && num_seams > 0) {
+        dp_storage full;
+        plan_storage(ctx, height, width, 0, 0, &full);
+        if (full.table == SC_TABLE_FULL) {
+            ctx->table = SC_TABLE_FULL;
+            double *best_arr = (double *)ctx_buffer(ctx, SLOT_COST, full.cost_bytes);
+#ifdef SC_THREADS
+            // Exact carves of large images share every seam across the pool
+            int workers = dp_workers(height, width);
+            if (workers > 1) {
+                int new_width = carve_parallel(ctx, work, best_arr, height, width, num_seams,
+                                               workers, log, progress);
+                if (new_width >= 0) {
+                    return new_width;
+                }
+            }
+#endif
+            if (tuning.pipeline != SC_PIPELINE_OFF) {
+                return carve_pipelined(ctx, work, best_arr, height, width, num_seams, log,
+                                       progress);
+            }
+        }
+    }
+    int *path = (int *)ctx_buffer(ctx, SLOT_PATH, height * sizeof(int));
+    int *lo = (int *)ctx_buffer(ctx, SLOT_LO, height * sizeof(int));
+    int *hi = (int *)ctx_buffer(ctx, SLOT_HI, height * sizeof(int));
+
+    dp_storage st;
+    plan_storage(ctx, height, width, band_margin, pad, &st);
+    if (st.table > ctx->table) {
+        ctx->steps_down += st.table - ctx->table;
+    }
+    ctx->table = st.table;
+    // Full table: energy map and costs; otherwise step bitmap and cost rows
+    uint8_t *energy_map = (uint8_t *)ctx_buffer_fit(ctx, SLOT_ENERGY, st.energy_bytes);
+    double *best_arr = (double *)ctx_buffer_fit(ctx, SLOT_COST, st.cost_bytes);
+    int cur_width = width;
+
+    for (int s = 0; s < num_seams; s++) {
+        int banded = st.margin > 0 && progress->seams > 0 &&
+                     (refresh_interval <= 0 || progress->since_exact < refresh_interval ||
+                      st.table == SC_TABLE_BAND);
+
+        if (banded) {
+            double cost;
+            set_window(lo, hi, height, cur_width, path, st.margin, pad);
+            if (st.table == SC_TABLE_FULL) {
+                fill_cost_window(work, best_arr, lo, hi, height, cur_width);
+                cost = find_seam_window(best_arr, lo, hi, height, cur_width, path);
+            }
+            else {
+                cost = find_seam_steps(work, lo, hi, height, cur_width, 2 * st.margin + 1, best_arr,
+                                       energy_map, path);
+            }
+
+            // The band has drifted away from cheap seams; fall back to a full DP
+            if (cost > progress->exact_cost * BAND_DRIFT_TOLERANCE && st.table != SC_TABLE_BAND) {
+                banded = 0;
+            }
+        }
+
+        if (banded) {
+            progress->since_exact++;
+        }
+        else if (st.table == SC_TABLE_BAND) {
+            for (int j = 0; j < height; j++) {
+                path[j] = cur_width / 2;
+            }
+            set_window(lo, hi, height, cur_width, path, st.margin, pad);
+            progress->exact_cost = find_seam_steps(work, lo, hi, height, cur_width,
+                                                   2 * st.margin + 1, best_arr, energy_map, path);
+            progress->since_exact = 0;
+        }
+        else if (st.table == SC_TABLE_BITMAP) {
+            set_window(lo, hi, height, cur_width, NULL, 0, pad);
+            progress->exact_cost = find_seam_steps(work, lo, hi, height, cur_width, cur_width,
+                                                   best_arr, energy_map, path);
+            progress->since_exact = 0;
+        }
+        else if (st.table == SC_TABLE_LINEAR) {
+            progress->exact_cost = find_seam_linear(work, height, cur_width, pad,
+                                                    cur_width - 1 - pad, best_arr, st.linear_rows,
+                                                    path);
+            progress->since_exact = 0;
+        }
+        else if (st.two_pass) {
+            calc_energy(work, energy_map, height, cur_width);
+            fill_cost(energy_map, best_arr, height, cur_width);
+            progress->exact_cost = find_seam(best_arr, height, cur_width, cur_width, path);
+            progress->since_exact = 0;
+        }
+        else {
+            set_window(lo, hi, height, cur_width, NULL, 0, pad);
+            fill_cost_window(work, best_arr, lo, hi, height, cur_width);
+            progress->exact_cost = find_seam_window(best_arr, lo, hi, height, cur_width, path);
+            progress->since_exact = 0;
+        }
+
+        if (log) {
+            log_seam(log, s, height, cur_width, path);
+            // Original columns are 4 bytes per pixel, just like RGBA
+            remove_seam_in_place((uint8_t *)log->index, height, cur_width, path);
+        }
+        remove_seam_in_place(work, height, cur_width, path);
+        cur_width--;
+        progress->seams++;
+        ctx->table_seams[st.table]++;
+    }
+
+    return cur_width;
+}
+
+// Carve num_seams seams out of a copy of src and record the order they went
+// in: order[j * width + i] is the seam that removed pixel (j, i), or
+// num_seams if it was kept. Seams are found greedily, so the first k of them
+// are exactly the seams carve_seams would remove for k, and one order serves
+// every target width down to width - num_seams (see apply_seam_order).
+// Returns 0, or -1 on invalid arguments.
+int carve_seam_order_ctx(sc_context *ctx, uint8_t *src, int height, int width, int num_seams,
+                         int band_margin, int refresh_interval, int32_t *order) {
+    if (num_seams < 0 || num_seams >= width) {
+        return -1;
+    }
+
+    uint8_t *work = (uint8_t *)ctx_buffer(ctx, SLOT_WORK, (size_t)height * width * 4);
+    int32_t *index = (int32_t *)ctx_buffer(ctx, SLOT_INDEX, (size_t)height * width * 4);
+    memcpy(work, src, (size_t)height * width * 4);
+    for (int j = 0; j < height; j++) {
+        for (int i = 0; i < width; i++) {
+            index[j * width + i] = i;
+            order[j * width + i] = num_seams;
+        }
+    }
+
+    seam_log log = {index, NULL, NULL, order, width};
+    carve_in_place(ctx, work, height, width, num_seams, band_margin, refresh_interval, 0, &log,
+                   NULL);
+    return 0;
+}
+
+// Write src without the first num_seams seams of its order to dest, which
+// must hold height * (width - num_seams) pixels
+void apply_seam_order(uint8_t *src, int height, int width, int32_t *order, int num_seams,
+                      uint8_t *dest) {
+    for (long k = 0; k < (long)height * width; k++) {
+        if (order[k] >= num_seams) {
+            memcpy(dest, src + 4 * k, 4);
+            dest += 4;
+        }
+    }
+}
+
+// Remove num_seams vertical seams and return a new (width - num_seams) image.
+// band_margin and refresh_interval select the banded "fast" mode described
+// at carve_in_place; band_margin = 0 gives the exact result of calling
+// seam_carve repeatedly. The working set comes from ctx.
+uint8_t *carve_seams_ctx(sc_context *ctx, uint8_t *src, int height, int width, int num_seams,
+                         int band_margin, int refresh_interval) {
+    if (num_seams < 0 || num_seams >= width) {
+        return NULL;
+    }
+
+    // Work on a private copy so the caller's image is left untouched
+    uint8_t *work = (uint8_t *)ctx_buffer(ctx, SLOT_WORK, height * width * 4);
+    memcpy(work, src, height * width * 4);
+
+    int new_width = carve_in_place(ctx, work, height, width, num_seams, band_margin,
+                                   refresh_interval, 0, NULL, NULL);
+
+    uint8_t *output = (uint8_t *)malloc(height * new_width * 4);
+    memcpy(output, work, height * new_width * 4);
+
+    return output;
+}
+
+EMSCRIPTEN_KEEPALIVE
+uint8_t *carve_seams(uint8_t *src, int height, int width, int num_seams,
+                     int band_margin, int refresh_interval) {
+    return carve_seams_ctx(&default_ctx, src, height, width, num_seams, band_margin,
+                           refresh_interval);
+}
+
+// Carve num_seams seams out of work in place, like carve_seams, and log each
+// one in original-image coordinates so callers can draw it: seam s is its
+// original column in row 0, starts[s], followed by height - 1 column steps in
+// steps[s * (height - 1) ...]. That is O(height) bytes per seam instead of a
+// frame. index holds the original column of every work pixel (int32, same
+// layout) and is carved along with it; fill each row with 0..width-1 before
+// the first call and keep passing both back to carve in batches. Steps fit in
+// int16 for images up to 32767 pixels wide. Returns the new width, or -1.
+EMSCRIPTEN_KEEPALIVE
+int carve_seams_logged(uint8_t *work, int32_t *index, int height, int width, int num_seams,
+                       int band_margin, int refresh_interval, int32_t *starts, int16_t *steps) {
+    if (num_seams < 0 || num_seams >= width) {
+        return -1;
+    }
+
+    seam_log log = {index, starts, steps, NULL, width};
+    return carve_in_place(&default_ctx, work, height, width, num_seams, band_margin,
+                          refresh_interval, 0, &log, NULL);
+}
+
+// Continue a carve done in batches: like carve_seams_logged, but with the
+// context's buffers and with the band state kept in progress, so a carve
+// split into any number of calls removes exactly the seams one call would.
+// width is the current width of work; seams are logged from starts[0].
+// Start with progress zeroed. Returns the new width, or -1.
+int carve_seams_resume_ctx(sc_context *ctx, uint8_t *work, int32_t *index, int height, int width,
+                           int num_seams, int band_margin, int refresh_interval,
+                           sc_progress *progress, int32_t *starts, int16_t *steps) {
+    if (num_seams < 0 || num_seams >= width) {
+        return -1;
+    }
+
+    seam_log log = {index, starts, steps, NULL, width};
+    return carve_in_place(ctx, work, height, width, num_seams, band_margin, refresh_interval, 0,
+                          &log, progress);
+}
+
+// Rebuild a carve from its seam log by removing num_seams logged seams
+// (starts and steps as carve_seams_logged records them) from work and index,
+// which hold the carve as it was before the first of them. The last seam is
+// left in ctx, so carve_seams_resume_ctx continues a banded carve around it
+// just as if it had never stopped. Returns the new width, or -1 if a seam
+// does not fit the image.
+int replay_seams_ctx(sc_context *ctx, uint8_t *work, int32_t *index, int height, int width,
+                     int num_seams, const int32_t *starts, const int16_t *steps) {
+    int *path = (int *)ctx_buffer(ctx, SLOT_PATH, height * sizeof(int));
+    int cur_width = width;
+
+    for (int s = 0; s < num_seams && cur_width > 1; s++) {
+        const int16_t *seam_steps = steps + (long)s * (height - 1);
+        int col = starts[s];
+
+        for (int j = 0; j < height; j++) {
+            if (j > 0) {
+                col += seam_steps[j - 1];
+            }
+            // Each row of index is ascending, so find the column by bisection
+            int32_t *row = index + (long)j * cur_width;
+            int lo = 0, hi = cur_width;
+            while (lo < hi) {
+                int mid = (lo + hi) / 2;
+                if (row[mid] < col) {
+                    lo = mid + 1;
+                }
+                else {
+                    hi = mid;
+                }
+            }
+            if (lo == cur_width || row[lo] != col) {
+                return -1;
+            }
+            path[j] = lo;
+        }
+
+        remove_seam_in_place((uint8_t *)index, height, cur_width, path);
+        remove_seam_in_place(work, height, cur_width, path);
+        cur_width--;
+    }
+
+    return (cur_width == width - num_seams) ? cur_width : -1;
+}
+
+// One vertical strip of carve_seams_strips. The strip is copied out with one
+// halo column on each side so the energy at its edges matches the full image.
+typedef struct {
+    sc_context *ctx;
+    uint8_t *buf;
+    int height;
+    int width;
+    int num_seams;
+    int band_margin;
+    int refresh_interval;
+} strip_job;
+
+static void *carve_strip(void *arg) {
+    strip_job *job = (strip_job *)arg;
+    carve_in_place(job->ctx, job->buf, job->height, job->width, job->num_seams,
+                   job->band_margin, job->refresh_interval, 1, NULL, NULL);
+    return NULL;
+}
+
+// Remove num_seams vertical seams by splitting the image into num_strips
+// vertical strips and carving each strip's share of seams independently (on
+// its own thread in SC_THREADS builds). Seams never cross a strip boundary,
+// so the result is slightly less optimal than carve_seams. The work is done
+// in rounds that each remove at most a quarter of every strip, and the strip
+// boundaries shift between rounds so no visible grid forms. Every strip
+// gets its own child context of ctx.
+uint8_t *carve_seams_strips_ctx(sc_context *ctx, uint8_t *src, int height, int width,
+                                int num_seams, int num_strips, int band_margin,
+                                int refresh_interval) {
+    if (num_seams < 0 || num_seams >= width) {
+        return NULL;
+    }
+    if (num_strips <= 1) {
+        return carve_seams_ctx(ctx, src, height, width, num_seams, band_margin, refresh_interval);
+    }
+    if (ctx->num_strips < num_strips) {
+        ctx->strips = (sc_context *)realloc(ctx->strips, num_strips * sizeof(sc_context));
+        memset(ctx->strips + ctx->num_strips, 0, (num_strips - ctx->num_strips) * sizeof(sc_context));
+        ctx->num_strips = num_strips;
+    }
+
+    uint8_t *work = (uint8_t *)ctx_buffer(ctx, SLOT_WORK, height * width * 4);
+    memcpy(work, src, height * width * 4);
+    strip_job *jobs = (strip_job *)malloc(num_strips * sizeof(strip_job));
+    int *x0 = (int *)malloc((num_strips + 1) * sizeof(int));
+#ifdef SC_THREADS
+    pthread_t *threads = (pthread_t *)malloc(num_strips * sizeof(pthread_t));
+#endif
+
+    int cur_width = width;
+    int removed = 0;
+
+    for (int round = 0; removed < num_seams; round++) {
+        int strips = cur_width / MIN_STRIP_WIDTH;
+        if (strips > num_strips) {
+            strips = num_strips;
+        }
+        if (strips < 1) {
+            strips = 1;
+        }
+
+        // Shift the boundaries by a golden-ratio step each round
+        int base = cur_width / strips;
+        int offset = (int)(round * base * 0.6180339887) % base;
+        x0[0] = 0;
+        for (int k = 1; k < strips; k++) {
+            x0[k] = offset + k * base;
+        }
+        x0[strips] = cur_width;
+
+        // Share this round's seams out in proportion to the strip widths
+        int capacity = 0;
+        for (int k = 0; k < strips; k++) {
+            capacity += (x0[k + 1] - x0[k]) / 4;
+        }
+        int this_round = num_seams - removed;
+        if (this_round > capacity) {
+            this_round = (capacity > 0) ? capacity : 1;
+        }
+
+        int assigned = 0;
+        for (int k = 0; k < strips; k++) {
+            int strip_width = x0[k + 1] - x0[k];
+            jobs[k].num_seams = (int)((long long)this_round * strip_width / cur_width);
+            assigned += jobs[k].num_seams;
+        }
+        for (int k = 0; assigned < this_round; k = (k + 1) % strips) {
+            int strip_width = x0[k + 1] - x0[k];
+            int limit = (capacity > 0) ? strip_width / 4 : strip_width - 1;
+            if (jobs[k].num_seams < limit) {
+                jobs[k].num_seams++;
+                assigned++;
+            }
+        }
+
+        // The strips share what the parent's memory limit leaves over, and
+        // at least step down to their smallest table if nothing is left
+        size_t strip_limit = 0;
+        if (ctx->memory_limit > 0) {
+            strip_limit = (ctx->memory_limit > ctx->bytes + strips)
+                              ? (ctx->memory_limit - ctx->bytes) / strips
+                              : 1;
+        }
+
+        // Copy every strip out together with its halo columns
+        for (int k = 0; k < strips; k++) {
+            int strip_width = x0[k + 1] - x0[k];
+            int halo_left = (x0[k] == 0) ? cur_width - 1 : x0[k] - 1;
+            int halo_right = (x0[k + 1] == cur_width) ? 0 : x0[k + 1];
+            int buf_width = strip_width + 2;
+
+            jobs[k].ctx = &ctx->strips[k];
+            jobs[k].ctx->memory_limit = strip_limit;
+            jobs[k].buf = (uint8_t *)ctx_buffer(jobs[k].ctx, SLOT_WORK, height * buf_width * 4);
+            jobs[k].height = height;
+            jobs[k].width = buf_width;
+            jobs[k].band_margin = band_margin;
+            jobs[k].refresh_interval = refresh_interval;
+
+            for (int j = 0; j < height; j++) {
+                uint8_t *row = work + 4 * j * cur_width;
+                uint8_t *dest = jobs[k].buf + 4 * j * buf_width;
+                memcpy(dest, row + 4 * halo_left, 4);
+                memcpy(dest + 4, row + 4 * x0[k], 4 * strip_width);
+                memcpy(dest + 4 * (strip_width + 1), row + 4 * halo_right, 4);
+            }
+        }
+
+#ifdef SC_THREADS
+        for (int k = 0; k < strips; k++) {
+            pthread_create(&threads[k], NULL, carve_strip, &jobs[k]);
+        }
+        for (int k = 0; k < strips; k++) {
+            pthread_join(threads[k], NULL);
+        }
+#else
+        for (int k = 0; k < strips; k++) {
+            carve_strip(&jobs[k]);
+        }
+#endif
+
+        // Stitch the carved strip interiors back together
+        int new_width = cur_width - this_round;
+        for (int j = 0; j < height; j++) {
+            uint8_t *dest = work + 4 * j * new_width;
+            for (int k = 0; k < strips; k++) {
+                int strip_width = x0[k + 1] - x0[k] - jobs[k].num_seams;
+                memcpy(dest, jobs[k].buf + 4 * (j * (jobs[k].width - jobs[k].num_seams) + 1),
+                       4 * strip_width);
+                dest += 4 * strip_width;
+            }
+        }
+
+        // Count the strips' seams and table steps in the parent
+        for (int k = 0; k < strips; k++) {
+            sc_context *strip = jobs[k].ctx;
+            for (int t = 0; t < SC_NUM_TABLES; t++) {
+                ctx->table_seams[t] += strip->table_seams[t];
+                strip->table_seams[t] = 0;
+            }
+            ctx->steps_down += strip->steps_down;
+            strip->steps_down = 0;
+            if (strip->table > ctx->table) {
+                ctx->table = strip->table;
+            }
+        }
+
+        cur_width = new_width;
+        removed += this_round;
+    }
+
+    uint8_t *output = (uint8_t *)malloc(height * cur_width * 4);
+    memcpy(output, work, height * cur_width * 4);
+
+    free(jobs);
+    free(x0);
+#ifdef SC_THREADS
+    free(threads);
+#endif
+
+    return output;
+}
+
+EMSCRIPTEN_KEEPALIVE
+uint8_t *carve_seams_strips(uint8_t *src, int height, int width, int num_seams,
+                            int num_strips, int band_margin, int refresh_interval) {
+    return carve_seams_strips_ctx(&default_ctx, src, height, width, num_seams, num_strips,
+                                  band_margin, refresh_interval);
+}
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+// Helper function to shrink every row of src to new_width pixels by linear
+// interpolation
+static void resample_rows(uint8_t *src, int height, int width, uint8_t *dest, int new_width) {
+    double scale = (new_width > 1) ? (double)(width - 1) / (new_width - 1) : 0;
+
+    for (int j = 0; j < height; j++) {
+        uint8_t *row = src + 4 * (long)j * width;
+        uint8_t *out = dest + 4 * (long)j * new_width;
+        for (int i = 0; i < new_width; i++) {
+            double x = i * scale;
+            int x0 = (int)x;
+            int x1 = (x0 + 1 < width) ? x0 + 1 : x0;
+            double t = x - x0;
+            for (int c = 0; c < 4; c++) {
+                out[4 * i + c] = (uint8_t)(row[4 * x0 + c] * (1 - t) + row[4 * x1 + c] * t + 0.5);
+            }
+        }
+    }
+}
+
+// Remove num_seams seams within about budget_ms, trading seam quality for
+// time as needed. Seams are found exactly while the measured time per exact
+// seam says the rest would still finish in budget; then banded around the
+// previous seam; then in batches of tuned-many strips; and whatever is
+// left when even that would run late is taken off by resampling the rows.
+// report, if not NULL, gets what was done. Returns a new
+// (width - num_seams) image, or NULL on invalid arguments.
+uint8_t *carve_seams_budget_ctx(sc_context *ctx, uint8_t *src, int height, int width,
+                                int num_seams, double budget_ms, sc_budget_report *report) {
+    if (num_seams < 0 || num_seams >= width) {
+        return NULL;
+    }
+
+    double start = now_ms();
+    sc_budget_report done = {0, 0, 0, 0, 0};
+    sc_progress progress = {0, 0, 0};
+    // Time kept back to resample and copy out the result
+    double reserve_ms = (double)height * width * tuning.resample_ns / 1e6;
+    double exact_ms = (double)height * width * tuning.exact_ns / 1e6;
+    double banded_ms = 0;
+    // A batch of strips costs about one full pass over the image plus a
+    // share per seam
+    double strips_ms = 0;
+
+    // A private copy, since strip mode works in the context's SLOT_WORK
+    uint8_t *work = (uint8_t *)malloc((size_t)height * width * 4);
+    memcpy(work, src, (size_t)height * width * 4);
+    int cur_width = width;
+
+    while (width - cur_width < num_seams) {
+        int remaining = num_seams - (width - cur_width);
+        double left = budget_ms - (now_ms() - start) - reserve_ms;
+        int banded;
+
+        if (done.seams_banded == 0 && done.seams_strips == 0 &&
+            (remaining * exact_ms <= left || (progress.seams == 0 && 2 * exact_ms <= left))) {
+            // The first exact seam also anchors the band, so take it as long
+            // as it fits with room for a cold start
+            banded = 0;
+        }
+        else if (done.seams_strips == 0 && progress.seams > 0 &&
+                 (done.seams_banded < BUDGET_SAMPLES || remaining * banded_ms <= left) &&
+                 banded_ms <= left) {
+            banded = 1;
+        }
+        else {
+            // The first batch is sized from a guess, so only half of it
+            double per_seam = strips_ms;
+            if (per_seam == 0) {
+                per_seam = (tuning.strips_ns > 0)
+                               ? height * tuning.strips_ns / 1e6
+                               : (banded_ms > 0 ? banded_ms : exact_ms / tuning.strips);
+            }
+            int batch = (int)((left - exact_ms) / per_seam);
+            if (strips_ms == 0) {
+                batch /= 2;
+            }
+            if (batch > remaining) {
+                batch = remaining;
+            }
+            if (batch < 1) {
+                break;
+            }
+
+            double t0 = now_ms();
+            uint8_t *carved = carve_seams_strips_ctx(ctx, work, height, cur_width, batch,
+                                                     tuning.strips, FAST_BAND_MARGIN, 0);
+            double ms = now_ms() - t0;
+            strips_ms = (ms > 2 * exact_ms ? ms - exact_ms : ms / 2) / batch;
+            cur_width -= batch;
+            memcpy(work, carved, (size_t)height * cur_width * 4);
+            free(carved);
+            done.seams_strips += batch;
+            continue;
+        }
+
+        double t0 = now_ms();
+        cur_width = carve_in_place(ctx, work, height, cur_width, 1,
+                                   banded ? FAST_BAND_MARGIN : 0, 0, 0, NULL, &progress);
+        // Smooth the times, since a banded seam sometimes falls back to a full DP
+        double ms = now_ms() - t0;
+        if (banded) {
+            banded_ms = (banded_ms > 0) ? 0.75 * banded_ms + 0.25 * ms : ms;
+            done.seams_banded++;
+        }
+        else {
+            exact_ms = done.seams_exact ? 0.75 * exact_ms + 0.25 * ms : ms;
+            done.seams_exact++;
+        }
+    }
+
+    int new_width = width - num_seams;
+    uint8_t *output = (uint8_t *)malloc((size_t)height * new_width * 4);
+    if (cur_width > new_width) {
+        done.seams_resampled = cur_width - new_width;
+        resample_rows(work, height, cur_width, output, new_width);
+    }
+    else {
+        memcpy(output, work, (size_t)height * new_width * 4);
+    }
+    free(work);
+
+    done.ms = now_ms() - start;
+    if (report) {
+        *report = done;
+    }
+    return output;
+}
+
+// carve_seams_budget_ctx for WASM callers: report receives seams exact,
+// banded, in strips, columns resampled, then elapsed microseconds
+EMSCRIPTEN_KEEPALIVE
+uint8_t *carve_seams_budget(uint8_t *src, int height, int width, int num_seams,
+                            double budget_ms, int32_t *report) {
+    sc_budget_report done;
+    uint8_t *output = carve_seams_budget_ctx(&default_ctx, src, height, width, num_seams,
+                                             budget_ms, &done);
+    if (output && report) {
+        report[0] = done.seams_exact;
+        report[1] = done.seams_banded;
+        report[2] = done.seams_strips;
+        report[3] = done.seams_resampled;
+        report[4] = (int32_t)(done.ms * 1000);
+    }
+    return output;
+}
+
+// Fraction of the image that is flat, from the energy of a grid of at most
+// FLAT_SAMPLES x FLAT_SAMPLES pixels
+double sc_flat_fraction(uint8_t *src, int height, int width) {
+    int rows = height < FLAT_SAMPLES ? height : FLAT_SAMPLES;
+    int cols = width < FLAT_SAMPLES ? width : FLAT_SAMPLES;
+    int flat = 0;
+
+    for (int r = 0; r < rows; r++) {
+        int j = (int)(((long)r * height + height / 2) / rows);
+        for (int c = 0; c < cols; c++) {
+            int i = (int)(((long)c * width + width / 2) / cols);
+            flat += pixel_energy(src, width, height, j, i) < FLAT_ENERGY;
+        }
+    }
+    return (double)flat / (rows * cols);
+}
+
+// Choose how to carve num_seams seams from src: the mode predicted to be
+// fastest among those the quality level allows (SC_QUALITY_*) whose
+// working set fits memory_limit bytes (0 for no limit). Runtimes are
+// predicted from the tuned per-seam times, counting the full DP over the
+// shrinking width that starts a band and every round of strips, and are
+// kept in plan for comparison with the actual run. Strips cannot cross their
+// boundaries, which costs little where the image is flat and cheap seams are
+// everywhere, so SC_QUALITY_HIGH also allows strips for mostly flat images.
+// Returns 0, or -1 if no allowed mode fits, in which case plan holds the
+// allowed mode with the smallest working set.
+int sc_plan_carve(uint8_t *src, int height, int width, int num_seams, int quality,
+                  size_t memory_limit, sc_plan *plan) {
+    // Without measured times, assume the ratios of a typical machine
+    double exact_ns = tuning.exact_ns;
+    double banded_ns = (tuning.banded_ns > 0) ? tuning.banded_ns : exact_ns * width / 3;
+    double strips_ns = (tuning.strips_ns > 0) ? tuning.strips_ns : exact_ns * width / 8;
+
+    memset(plan, 0, sizeof(*plan));
+    plan->flat_fraction = sc_flat_fraction(src, height, width);
+    // The width shrinks by one with every seam
+    double mean_width = width - num_seams / 2.0;
+    double full_dp_ms = (double)height * mean_width * exact_ns / 1e6;
+    double rows = (double)height * num_seams / 1e6;
+    // Every round of strips takes at most a quarter of the width
+    double rounds = ceil(num_seams / (mean_width / 4));
+
+    plan->predicted_ms[SC_PLAN_EXACT] = num_seams * full_dp_ms;
+    plan->predicted_ms[SC_PLAN_BANDED] = full_dp_ms + rows * banded_ns;
+    plan->predicted_ms[SC_PLAN_STRIPS] = rounds * full_dp_ms + rows * strips_ns;
+    plan->predicted_bytes[SC_PLAN_EXACT] = sc_estimate_bytes(height, width, SC_MODE_CARVE);
+    plan->predicted_bytes[SC_PLAN_BANDED] = sc_estimate_bytes(height, width, SC_MODE_CARVE);
+    plan->predicted_bytes[SC_PLAN_STRIPS] = sc_estimate_bytes(height, width, SC_MODE_STRIPS);
+
+    int allowed = quality;
+    if (quality == SC_QUALITY_HIGH && plan->flat_fraction >= FLAT_STRIPS_FRACTION) {
+        allowed = SC_PLAN_STRIPS;
+    }
+    int best = -1;
+    int smallest = SC_PLAN_EXACT;
+    for (int mode = SC_PLAN_EXACT; mode <= allowed && mode < SC_NUM_PLANS; mode++) {
+        if (plan->predicted_bytes[mode] < plan->predicted_bytes[smallest]) {
+            smallest = mode;
+        }
+        if (memory_limit > 0 && plan->predicted_bytes[mode] > memory_limit) {
+            continue;
+        }
+        if (best < 0 || plan->predicted_ms[mode] < plan->predicted_ms[best]) {
+            best = mode;
+        }
+    }
+
+    plan->mode = (best >= 0) ? best : smallest;
+    plan->band_margin = (plan->mode == SC_PLAN_EXACT) ? 0 : FAST_BAND_MARGIN;
+    plan->strips = (plan->mode == SC_PLAN_STRIPS) ? tuning.strips : 1;
+    return (best >= 0) ? 0 : -1;
+}
+
+// Images are carved in groups of SC_LANES, in lockstep. Pixels are stored
+// channel-planar with the images interleaved, so element
+// [(j * width + i) * SC_LANES + lane] of a plane belongs to image `lane`, and
+// every vector operation advances all images of the group at once. Rows keep
+// their original stride, only the first cur_width columns are live.
+
+// Helper function to load images first.. of srcs into the planes of a group
+static void load_lane_planes(uint8_t **srcs, int lanes, int first, long pixels, lane_vec *planes) {
+    for (long p = 0; p < pixels; p++) {
+        for (int l = 0; l < SC_LANES; l++) {
+            // Unused lanes repeat the last image; their result is dropped
+            int n = (first + l < lanes) ? first + l : lanes - 1;
+            uint8_t *px = srcs[n] + 4 * p;
+            for (int c = 0; c < 4; c++) {
+                planes[c * pixels + p][l] = px[c];
+            }
+        }
+    }
+}
+
+// Helper function to write the live part of a group's images to new dests
+static void store_lane_planes(lane_vec *planes, uint8_t **dests, int lanes, int height, int width,
+                              int cur_width) {
+    long pixels = (long)height * width;
+    for (int l = 0; l < lanes; l++) {
+        uint8_t *out = (uint8_t *)malloc(height * cur_width * 4);
+        for (int j = 0; j < height; j++) {
+            for (int i = 0; i < cur_width; i++) {
+                for (int c = 0; c < 4; c++) {
+                    out[4 * (j * cur_width + i) + c] = planes[c * pixels + j * width + i][l];
+                }
+            }
+        }
+        dests[l] = out;
+    }
+}
+
+// Energy of pixel (j, i) of every image of a group, w pixels wide
+static inline lane_vec lane_energy(lane_vec *planes, long pixels, int height, int width, int w,
+                                   int j, int i) {
+    int up = (j == 0) ? height - 1 : j - 1;
+    int down = (j == height - 1) ? 0 : j + 1;
+    int left = (i == 0) ? w - 1 : i - 1;
+    int right = (i == w - 1) ? 0 : i + 1;
+    lane_vec grad = { 0 };
+
+    for (int c = 0; c < 3; c++) {
+        lane_vec *plane = planes + c * pixels;
+        lane_vec dx = plane[j * width + right] - plane[j * width + left];
+        lane_vec dy = plane[up * width + i] - plane[down * width + i];
+        grad += dx * dx + dy * dy;
+    }
+
+    // energy / 10 == floor(sqrt(grad) / 10): the largest e with
+    // 100 * e * e <= grad, found by a branch-free binary search
+    lane_vec energy = { 0 };
+    for (int step = 32; step > 0; step /= 2) {
+        lane_vec cand = energy + step;
+        lane_vec fits = (cand * cand * 100) <= grad;
+        energy = (cand & fits) | (energy & ~fits);
+    }
+    return energy;
+}
+
+// Helper function to remove one seam per image of a group. Right of its
+// own seam, every lane takes the pixel from the next column.
+static void remove_lane_seams(lane_vec *planes, long pixels, int height, int width, int w,
+                              lane_vec *path) {
+    for (int j = 0; j < height; j++) {
+        int from = path[j][0];
+        for (int l = 1; l < SC_LANES; l++) {
+            from = (path[j][l] < from) ? path[j][l] : from;
+        }
+
+        for (int i = from; i < w - 1; i++) {
+            lane_vec shift = path[j] <= i;
+            for (int c = 0; c < 4; c++) {
+                lane_vec *px = planes + c * pixels + j * width + i;
+                px[0] = (px[1] & shift) | (px[0] & ~shift);
+            }
+        }
+    }
+}
+
+// Carve one group of SC_LANES images with 32-bit costs
+static void carve_lane_group(uint8_t **srcs, uint8_t **dests, int lanes, int height, int width,
+                             int num_seams, lane_vec *planes, lane_vec *cost, lane_vec *path) {
+    long pixels = (long)height * width;
+    load_lane_planes(srcs, lanes, 0, pixels, planes);
+
+    int cur_width = width;
+    for (int s = 0; s < num_seams; s++) {
+        int w = cur_width;
+
+        for (int j = 0; j < height; j++) {
+            for (int i = 0; i < w; i++) {
+                lane_vec energy = lane_energy(planes, pixels, height, width, w, j, i);
+
+                lane_vec *cell = cost + j * width + i;
+                if (j == 0) {
+                    *cell = energy;
+                    continue;
+                }
+
+                lane_vec *prev = cost + (j - 1) * width;
+                lane_vec min = prev[i];
+                if (i > 0) {
+                    lane_vec less = prev[i - 1] < min;
+                    min = (prev[i - 1] & less) | (min & ~less);
+                }
+                if (i < w - 1) {
+                    lane_vec less = prev[i + 1] < min;
+                    min = (prev[i + 1] & less) | (min & ~less);
+                }
+                *cell = energy + min;
+            }
+        }
+
+        // Backtracking differs per image, so it runs lane by lane with the
+        // same tie-breaking as find_seam
+        for (int l = 0; l < SC_LANES; l++) {
+            int min_idx = 0;
+            for (int i = 1; i < w; i++) {
+                if (cost[(height - 1) * width + i][l] < cost[(height - 1) * width + min_idx][l]) {
+                    min_idx = i;
+                }
+            }
+            path[height - 1][l] = min_idx;
+
+            for (int j = height - 2; j >= 0; j--) {
+                int prev_idx = path[j + 1][l];
+                min_idx = prev_idx;
+                if (prev_idx > 0 && cost[j * width + prev_idx - 1][l] < cost[j * width + min_idx][l]) {
+                    min_idx = prev_idx - 1;
+                }
+                if (prev_idx < w - 1 && cost[j * width + prev_idx + 1][l] < cost[j * width + min_idx][l]) {
+                    min_idx = prev_idx + 1;
+                }
+                path[j][l] = min_idx;
+            }
+        }
+
+        remove_lane_seams(planes, pixels, height, width, w, path);
+        cur_width--;
+    }
+
+    store_lane_planes(planes, dests, lanes, height, width, cur_width);
+}
+
+// Carve SC_LANES16 images as two groups that share one DP with 16-bit
+// costs, twice as many per vector. Energy needs 32 bits, so it is computed
+// per group and narrowed.
+//
+// Each DP row is renormalized as it is filled: the minimum of the row above
+// is subtracted from every cell, so costs stay near the spread of one row
+// instead of growing with the height. That shifts a whole row by the same
+// amount per image and changes no comparison, so the seams are those of the
+// 32-bit DP. Additions saturate, and since a saturated cell could change a
+// comparison the carve gives up and returns -1 if one ever does (dests are
+// then left unset). Returns 0 otherwise.
+static int carve_lane_group16(uint8_t **srcs, uint8_t **dests, int lanes, int height, int width,
+                              int num_seams, lane_vec *planes, lane16_vec *cost, lane_vec *path) {
+    long pixels = (long)height * width;
+    lane_vec *halves[2] = { planes, planes + 4 * pixels };
+    lane_vec *paths[2] = { path, path + height };
+    load_lane_planes(srcs, lanes, 0, pixels, halves[0]);
+    load_lane_planes(srcs, lanes, SC_LANES, pixels, halves[1]);
+
+    int cur_width = width;
+    for (int s = 0; s < num_seams; s++) {
+        int w = cur_width;
+        lane16_vec saturated = { 0 };
+        lane16_vec prev_min = { 0 };
+
+        for (int j = 0; j < height; j++) {
+            lane16_vec row_min;
+            memset(&row_min, 0xff, sizeof(row_min));
+
+            for (int i = 0; i < w; i++) {
+                lane_vec lo = lane_energy(halves[0], pixels, height, width, w, j, i);
+                lane_vec hi = lane_energy(halves[1], pixels, height, width, w, j, i);
+                lane16_vec energy = __builtin_convertvector(
+                    __builtin_shufflevector(lo, hi, LANES16_ORDER), lane16_vec);
+
+                lane16_vec cell = energy;
+                if (j > 0) {
+                    lane16_vec *prev = cost + (j - 1) * width;
+                    lane16_vec min = prev[i];
+                    if (i > 0) {
+                        lane16_vec less = (lane16_vec)(prev[i - 1] < min);
+                        min = (prev[i - 1] & less) | (min & ~less);
+                    }
+                    if (i < w - 1) {
+                        lane16_vec less = (lane16_vec)(prev[i + 1] < min);
+                        min = (prev[i + 1] & less) | (min & ~less);
+                    }
+                    // min >= prev_min, so only the addition can wrap, and a
+                    // wrapped cell sticks at 0xffff
+                    cell = energy + (min - prev_min);
+                    lane16_vec over = (lane16_vec)(cell < energy);
+                    cell |= over;
+                    saturated |= over;
+                }
+                cost[j * width + i] = cell;
+
+                lane16_vec less = (lane16_vec)(cell < row_min);
+                row_min = (cell & less) | (row_min & ~less);
+            }
+            prev_min = row_min;
+        }
+
+        for (int l = 0; l < SC_LANES16; l++) {
+            if (saturated[l]) {
+                return -1;
+            }
+        }
+
+        // Backtracking as in carve_lane_group
+        for (int l = 0; l < SC_LANES16; l++) {
+            lane_vec *lane_path = paths[l / SC_LANES];
+            int k = l % SC_LANES;
+            int min_idx = 0;
+            for (int i = 1; i < w; i++) {
+                if (cost[(height - 1) * width + i][l] < cost[(height - 1) * width + min_idx][l]) {
+                    min_idx = i;
+                }
+            }
+            lane_path[height - 1][k] = min_idx;
+
+            for (int j = height - 2; j >= 0; j--) {
+                lane16_vec *row = cost + j * width;
+                int prev_idx = lane_path[j + 1][k];
+                min_idx = prev_idx;
+                if (prev_idx > 0 && row[prev_idx - 1][l] < row[min_idx][l]) {
+                    min_idx = prev_idx - 1;
+                }
+                if (prev_idx < w - 1 && row[prev_idx + 1][l] < row[min_idx][l]) {
+                    min_idx = prev_idx + 1;
+                }
+                lane_path[j][k] = min_idx;
+            }
+        }
+
+        remove_lane_seams(halves[0], pixels, height, width, w, paths[0]);
+        remove_lane_seams(halves[1], pixels, height, width, w, paths[1]);
+        cur_width--;
+    }
+
+    store_lane_planes(halves[0], dests, SC_LANES, height, width, cur_width);
+    store_lane_planes(halves[1], dests + SC_LANES, lanes - SC_LANES, height, width, cur_width);
+    return 0;
+}
+
+// Remove num_seams seams from each of count same-sized images in one call,
+// writing a new (width - num_seams) image for every srcs[n] to dests[n].
+// Meant for small thumbnails, where short rows leave the vector units idle:
+// the images are carved SC_LANES at a time with one image per SIMD lane.
+// With tuning.lanes16, up to SC_LANES16 at a time share a DP with 16-bit
+// costs, unless those saturate. Integer costs make the result identical to
+// carve_seams. Returns 0 on success and -1 on invalid arguments.
+int carve_seams_lanes_ctx(sc_context *ctx, uint8_t **srcs, uint8_t **dests, int count,
+                          int height, int width, int num_seams) {
+    if (count <= 0 || num_seams < 0 || num_seams >= width) {
+        return -1;
+    }
+
+    // A lane16_vec is as large as a lane_vec, so the cost buffer serves both
+    long pixels = (long)height * width;
+    int pairs = tuning.lanes16 && count > SC_LANES;
+    lane_vec *planes = (lane_vec *)ctx_buffer(ctx, SLOT_WORK,
+                                              (pairs ? 8 : 4) * pixels * sizeof(lane_vec));
+    lane_vec *cost = (lane_vec *)ctx_buffer(ctx, SLOT_COST, pixels * sizeof(lane_vec));
+    lane_vec *path = (lane_vec *)ctx_buffer(ctx, SLOT_PATH,
+                                            (pairs ? 2 : 1) * height * sizeof(lane_vec));
+
+    for (int n = 0; n < count;) {
+        int lanes = (count - n < SC_LANES16) ? count - n : SC_LANES16;
+        // Two groups only pay for a shared DP if both have images
+        if (pairs && lanes > SC_LANES &&
+            carve_lane_group16(srcs + n, dests + n, lanes, height, width, num_seams, planes,
+                               (lane16_vec *)cost, path) == 0) {
+            n += lanes;
+            continue;
+        }
+        lanes = (lanes < SC_LANES) ? lanes : SC_LANES;
+        carve_lane_group(srcs + n, dests + n, lanes, height, width, num_seams, planes, cost, path);
+        n += lanes;
+    }
+
+    return 0;
+}
+
+EMSCRIPTEN_KEEPALIVE
+int carve_seams_lanes(uint8_t **srcs, uint8_t **dests, int count, int height, int width,
+                      int num_seams) {
+    return carve_seams_lanes_ctx(&default_ctx, srcs, dests, count, height, width, num_seams);
+}
+
+// Mark the pixels whose energy may differ from the previous frame: every
+// changed pixel and its four (wrapping) neighbours. Returns the number of
+// pixels that changed.
+static long mark_changed(uint8_t *frame, uint8_t *prev, uint8_t *dirty, int height, int width) {
+    long changed = 0;
+    memset(dirty, 0, height * width);
+
+    for (int j = 0; j < height; j++) {
+        for (int i = 0; i < width; i++) {
+            uint8_t *a = frame + 4 * (j * width + i);
+            uint8_t *b = prev + 4 * (j * width + i);
+            if (a[0] == b[0] && a[1] == b[1] && a[2] == b[2]) {
+                continue;
+            }
+
+            changed++;
+            int up = (j == 0) ? height - 1 : j - 1;
+            int down = (j == height - 1) ? 0 : j + 1;
+            int left = (i == 0) ? width - 1 : i - 1;
+            int right = (i == width - 1) ? 0 : i + 1;
+            dirty[j * width + i] = 1;
+            dirty[j * width + left] = 1;
+            dirty[j * width + right] = 1;
+            dirty[up * width + i] = 1;
+            dirty[down * width + i] = 1;
+        }
+    }
+
+    return changed;
+}
+
+// True when no pixel inside the per-row windows is marked dirty
+static int window_clean(uint8_t *dirty, int *lo, int *hi, int height, int width) {
+    for (int j = 0; j < height; j++) {
+        if (memchr(dirty + j * width + lo[j], 1, hi[j] - lo[j] + 1)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Once this frame's seam differs from the previous frame's in a row, the
+// pixels between the two seams no longer line up with the previous frame, and
+// neither do their vertical neighbours' energies
+static void mark_seam_drift(uint8_t *dirty, int *path, int *prev_path, int height, int width) {
+    for (int j = 0; j < height; j++) {
+        if (path[j] == prev_path[j]) {
+            continue;
+        }
+
+        int from = (path[j] < prev_path[j]) ? path[j] - 1 : prev_path[j] - 1;
+        int to = (path[j] > prev_path[j]) ? path[j] + 1 : prev_path[j] + 1;
+        from = (from < 0) ? 0 : from;
+        to = (to > width - 1) ? width - 1 : to;
+
+        for (int r = j - 1; r <= j + 1; r++) {
+            int row = (r + height) % height;
+            memset(dirty + row * width + from, 1, to - from + 1);
+        }
+    }
+}
+
+// Drop the seam column from every row of the dirty mask, like remove_seam_in_place
+static void remove_mask_seam(uint8_t *mask, int height, int width, int *path) {
+    for (int j = 0; j < height; j++) {
+        uint8_t *src_row = mask + j * width;
+        uint8_t *dest_row = mask + j * (width - 1);
+        int seam = path[j];
+
+        memmove(dest_row, src_row, seam);
+        memmove(dest_row + seam, src_row + seam + 1, width - 1 - seam);
+    }
+}
+
+// Create the state for carving num_seams seams out of every frame of a
+// height x width video. band_margin is how far a seam may move between
+// consecutive frames.
+EMSCRIPTEN_KEEPALIVE
+video_state *video_create(int height, int width, int num_seams, int band_margin) {
+    if (num_seams < 0 || num_seams >= width) {
+        return NULL;
+    }
+
+    video_state *vs = (video_state *)calloc(1, sizeof(video_state));
+    vs->height = height;
+    vs->width = width;
+    vs->num_seams = num_seams;
+    vs->band_margin = band_margin;
+    vs->prev_frame = (uint8_t *)malloc(height * width * 4);
+    vs->prev_output = (uint8_t *)malloc(height * (width - num_seams) * 4);
+    vs->seams = (int *)malloc((num_seams > 0 ? num_seams : 1) * height * sizeof(int));
+    vs->costs = (double *)malloc((num_seams > 0 ? num_seams : 1) * sizeof(double));
+    vs->dirty = (uint8_t *)malloc(height * width);
+    return vs;
+}
+
+// Carve one video frame and return a new (width - num_seams) frame.
+//
+// Every seam is warm-started from the same seam of the previous frame: if
+// none of the pixels around it changed, the previous seam is reused as is;
+// otherwise it is searched only within band_margin columns of the previous
+// one, with a full DP when the banded seam got noticeably more expensive. A
+// frame identical to the previous one reuses the previous output, and a frame
+// where most pixels changed (a scene cut) is carved from scratch. Keeping the
+// seams close to the previous frame's is also what keeps the output from
+// flickering.
+EMSCRIPTEN_KEEPALIVE
+uint8_t *video_carve_frame(video_state *vs, uint8_t *frame) {
+    int height = vs->height;
+    int width = vs->width;
+    int out_width = width - vs->num_seams;
+    uint8_t *output = (uint8_t *)malloc(height * out_width * 4);
+
+    vs->seams_reused = 0;
+    vs->seams_banded = 0;
+    vs->seams_exact = 0;
+
+    int warm = 0;
+    if (vs->frames > 0) {
+        long changed = mark_changed(frame, vs->prev_frame, vs->dirty, height, width);
+        if (changed == 0) {
+            memcpy(output, vs->prev_output, height * out_width * 4);
+            vs->seams_reused = vs->num_seams;
+            vs->frames++;
+            return output;
+        }
+        warm = changed <= SCENE_CUT_FRACTION * height * width && vs->band_margin > 0;
+    }
+
+    sc_context *ctx = &vs->ctx;
+    uint8_t *work = (uint8_t *)ctx_buffer(ctx, SLOT_WORK, height * width * 4);
+    memcpy(work, frame, height * width * 4);
+    memcpy(vs->prev_frame, frame, height * width * 4);
+
+    uint8_t *energy_map = (uint8_t *)ctx_buffer(ctx, SLOT_ENERGY, height * width * 4);
+    double *best_arr = (double *)ctx_buffer(ctx, SLOT_COST, height * width * sizeof(double));
+    int *path = (int *)ctx_buffer(ctx, SLOT_PATH, height * sizeof(int));
+    int *lo = (int *)ctx_buffer(ctx, SLOT_LO, height * sizeof(int));
+    int *hi = (int *)ctx_buffer(ctx, SLOT_HI, height * sizeof(int));
+
+    int cur_width = width;
+    for (int s = 0; s < vs->num_seams; s++) {
+        int *prev_path = vs->seams + s * height;
+        int found = 0;
+
+        if (warm) {
+            set_window(lo, hi, height, cur_width, prev_path, vs->band_margin, 0);
+
+            if (window_clean(vs->dirty, lo, hi, height, cur_width)) {
+                memcpy(path, prev_path, height * sizeof(int));
+                vs->seams_reused++;
+                found = 1;
+            }
+            else {
+                fill_cost_window(work, best_arr, lo, hi, height, cur_width);
+                double cost = find_seam_window(best_arr, lo, hi, height, cur_width, path);
+                if (cost <= vs->costs[s] * BAND_DRIFT_TOLERANCE) {
+                    vs->costs[s] = cost;
+                    vs->seams_banded++;
+                    found = 1;
+                }
+            }
+        }
+
+        if (!found) {
+            calc_energy(work, energy_map, height, cur_width);
+            fill_cost(energy_map, best_arr, height, cur_width);
+            vs->costs[s] = find_seam(best_arr, height, cur_width, cur_width, path);
+            vs->seams_exact++;
+        }
+
+        if (warm) {
+            mark_seam_drift(vs->dirty, path, prev_path, height, cur_width);
+            remove_mask_seam(vs->dirty, height, cur_width, path);
+        }
+        memcpy(prev_path, path, height * sizeof(int));
+
+        remove_seam_in_place(work, height, cur_width, path);
+        cur_width--;
+    }
+
+    memcpy(output, work, height * out_width * 4);
+    memcpy(vs->prev_output, output, height * out_width * 4);
+    vs->frames++;
+
+    return output;
+}
+
+EMSCRIPTEN_KEEPALIVE
+void video_destroy(video_state *vs) {
+    sc_context_reset(&vs->ctx);
+    free(vs->prev_frame);
+    free(vs->prev_output);
+    free(vs->seams);
+    free(vs->costs);
+    free(vs->dirty);
+    free(vs);
+}
+
+// Helper function for the first row of a heatmap cell: cells split the image
+// as evenly as integer division allows
+static inline int cell_start(int cell, int size, int cells) {
+    return (int)(((long)cell * size + cells - 1) / cells);
+}
+
+// Write an out_height x out_width preview of the energy (HEATMAP_ENERGY) or
+// cumulative seam cost (HEATMAP_COST) of an image to out, one byte per
+// pixel. Each output pixel is the mean of the image pixels it covers. Energy
+// is scaled by its maximum; cost grows down the image, so every output row is
+// scaled between its own minimum and maximum instead. The energy and cost are
+// computed on the fly in a single pass, keeping only two rows of the DP table.
+// Returns 0, or -1 on invalid arguments.
+EMSCRIPTEN_KEEPALIVE
+int heatmap(uint8_t *src, int height, int width, int kind, uint8_t *out, int out_height,
+            int out_width) {
+    if (out_height < 1 || out_height > height || out_width < 1 || out_width > width ||
+        (kind != HEATMAP_ENERGY && kind != HEATMAP_COST)) {
+        return -1;
+    }
+
+    double *acc = (double *)ctx_buffer(&default_ctx, SLOT_ENERGY,
+                                       (size_t)out_height * out_width * sizeof(double));
+    double *rows = (double *)ctx_buffer(&default_ctx, SLOT_COST, 2 * (size_t)width * sizeof(double));
+    memset(acc, 0, (size_t)out_height * out_width * sizeof(double));
+
+    for (int j = 0; j < height; j++) {
+        double *cur = rows + (j % 2) * width;
+        double *prev = rows + ((j + 1) % 2) * width;
+        double *acc_row = acc + (long)j * out_height / height * out_width;
+
+        for (int i = 0; i < width; i++) {
+            double value = pixel_energy(src, width, height, j, i);
+
+            if (kind == HEATMAP_COST) {
+                if (j > 0) {
+                    double min = prev[i];
+                    if (i > 0) {
+                        min = min_2(min, prev[i - 1]);
+                    }
+                    if (i < width - 1) {
+                        min = min_2(min, prev[i + 1]);
+                    }
+                    value += min;
+                }
+                cur[i] = value;
+            }
+            acc_row[(long)i * out_width / width] += value;
+        }
+    }
+
+    // Turn the sums into means
+    double max = 0;
+    for (int y = 0; y < out_height; y++) {
+        int rows_in_cell = cell_start(y + 1, height, out_height) - cell_start(y, height, out_height);
+        for (int x = 0; x < out_width; x++) {
+            int cols_in_cell = cell_start(x + 1, width, out_width) - cell_start(x, width, out_width);
+            acc[y * out_width + x] /= (double)rows_in_cell * cols_in_cell;
+            max = (acc[y * out_width + x] > max) ? acc[y * out_width + x] : max;
+        }
+    }
+
+    for (int y = 0; y < out_height; y++) {
+        double *acc_row = acc + y * out_width;
+        double lo = 0;
+        double hi = max;
+
+        if (kind == HEATMAP_COST) {
+            lo = hi = acc_row[0];
+            for (int x = 1; x < out_width; x++) {
+                lo = (acc_row[x] < lo) ? acc_row[x] : lo;
+                hi = (acc_row[x] > hi) ? acc_row[x] : hi;
+            }
+        }
+
+        double scale = (hi > lo) ? 255.0 / (hi - lo) : 0.0;
+        for (int x = 0; x < out_width; x++) {
+            out[y * out_width + x] = (uint8_t)((acc_row[x] - lo) * scale + 0.5);
+        }
+    }
+
+    return 0;
 }
 
 // Helper function to get image dimensions
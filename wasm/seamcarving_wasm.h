@@ -0,0 +1,174 @@
+#if !defined(SEAMCARVING_WASM_H)
+#define SEAMCARVING_WASM_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define SC_NUM_SLOTS 7
+
+// Engine modes, for sc_estimate_bytes
+#define SC_MODE_CARVE 0     // carve_seams, exact or banded
+#define SC_MODE_STRIPS 1    // carve_seams_strips
+#define SC_MODE_ORDER 2     // carve_seam_order_ctx
+
+// Modes sc_plan_carve chooses between
+#define SC_PLAN_EXACT 0     // carve_seams with a full DP per seam
+#define SC_PLAN_BANDED 1    // carve_seams with a band
+#define SC_PLAN_STRIPS 2    // carve_seams_strips with a band
+#define SC_NUM_PLANS 3
+
+// Quality levels for sc_plan_carve: the modes up to and including the
+// same-numbered SC_PLAN_* are allowed
+#define SC_QUALITY_EXACT 0
+#define SC_QUALITY_HIGH 1
+#define SC_QUALITY_FAST 2
+
+// How a carve stores the DP of a seam, from the fastest to the smallest. A
+// context with a memory_limit steps down this list until its working set
+// fits; the first three find exactly the seams the full table does.
+#define SC_TABLE_FULL 0      // cost of every pixel
+#define SC_TABLE_BITMAP 1    // a 2-bit step per pixel and two cost rows
+#define SC_TABLE_LINEAR 2    // a few cost rows, recomputed while backtracking
+#define SC_TABLE_BAND 3      // steps within a band around the previous seam
+#define SC_NUM_TABLES 4
+
+// How exact seams overlap removing one seam with the DP of the next
+#define SC_PIPELINE_OFF 0     // separate passes: remove, then energy and DP
+#define SC_PIPELINE_ROWS 1    // one row sweep does both
+#define SC_PIPELINE_SPLIT 2   // the same, with removal on a second thread
+
+// Kinds of heatmap
+#define HEATMAP_ENERGY 0
+#define HEATMAP_COST 1
+
+// Working buffers kept between carves, so carving a series of similarly sized
+// images allocates (and, in WASM, grows memory) only for the first one
+typedef struct sc_context {
+    void *slots[SC_NUM_SLOTS];
+    size_t caps[SC_NUM_SLOTS];
+    size_t bytes;                 // bytes currently held by the slots
+    size_t peak_bytes;            // high-water mark of bytes
+    size_t memory_limit;          // cap on bytes, 0 for none
+    int table;                    // SC_TABLE_* of the last carve
+    long table_seams[SC_NUM_TABLES];   // seams found with each table
+    long steps_down;              // tables stepped down to fit memory_limit
+    struct sc_context *strips;    // per-strip contexts of carve_seams_strips
+    int num_strips;
+} sc_context;
+
+// How far a carve done in batches has got, enough to continue it exactly
+// (see carve_seams_resume_ctx)
+typedef struct {
+    int seams;            // seams removed so far
+    int since_exact;      // banded seams since the last full DP
+    double exact_cost;    // cost of the last full-DP seam
+} sc_progress;
+
+// Machine-dependent engine choices, normally from the autotune profile.
+// An exact seam costs the same for every pixel of the image; a banded seam
+// only searches its band, so its cost is per row and leaves out the full DP
+// that starts the band.
+typedef struct {
+    int fused_energy;     // exact DP computes energy on the fly, not in a separate pass
+    int strips;           // strips of carve_seams_budget_ctx's strip mode
+    double exact_ns;      // time of an exact seam per pixel
+    double banded_ns;     // time of a banded seam per row, 0 if unknown
+    double strips_ns;     // time of a seam in strip mode per row, 0 if unknown
+    double resample_ns;   // time to resample one pixel
+    int dp_threads;       // threads sharing the DP of an exact seam, 1 for none
+    double parallel_pixels;   // image pixels per DP thread that make one worth it
+    int pipeline;         // SC_PIPELINE_* of exact seams
+    int lanes16;          // carve_seams_lanes pairs groups of images in a 16-bit DP
+} sc_tuning;
+
+// sc_plan_carve's choice, with the arguments to carve it and the predictions
+// for every mode
+typedef struct {
+    int mode;             // SC_PLAN_*
+    int band_margin;
+    int strips;
+    double flat_fraction;
+    double predicted_ms[SC_NUM_PLANS];
+    size_t predicted_bytes[SC_NUM_PLANS];
+} sc_plan;
+
+// What carve_seams_budget_ctx did to stay within its time budget
+typedef struct {
+    int seams_exact;
+    int seams_banded;
+    int seams_strips;
+    int seams_resampled;  // columns taken off by resampling instead of seams
+    double ms;
+} sc_budget_report;
+
+// State carried between the frames of a video carved with video_carve_frame
+typedef struct {
+    int height;
+    int width;
+    int num_seams;
+    int band_margin;
+    int frames;
+    uint8_t *prev_frame;   // previous input frame, RGBA
+    uint8_t *prev_output;  // previous carved frame, RGBA
+    int *seams;            // num_seams x height seam columns of the previous frame
+    double *costs;         // cost of every seam of the previous frame
+    uint8_t *dirty;        // per-pixel "differs from the previous frame" mask
+    int seams_reused;      // seams copied from the previous frame (last frame)
+    int seams_banded;      // seams searched in a band around the previous frame's
+    int seams_exact;       // seams found with a full DP
+    sc_context ctx;
+} video_state;
+
+sc_context *sc_context_create(void);
+void sc_context_reset(sc_context *ctx);
+void sc_context_destroy(sc_context *ctx);
+size_t sc_workspace_bytes(int height, int width);
+size_t sc_estimate_bytes(int height, int width, int mode);
+int sc_reserve(int height, int width);
+void sc_reset(void);
+void sc_set_memory_limit(size_t bytes);
+void sc_set_tuning(const sc_tuning *t);
+void sc_get_tuning(sc_tuning *t);
+
+uint8_t *create_image(int height, int width);
+void free_image(uint8_t *img);
+void calc_energy(uint8_t *src, uint8_t *dest, int height, int width);
+uint8_t *seam_carve(uint8_t *src, int height, int width);
+uint8_t *carve_seams(uint8_t *src, int height, int width, int num_seams,
+                     int band_margin, int refresh_interval);
+uint8_t *carve_seams_ctx(sc_context *ctx, uint8_t *src, int height, int width, int num_seams,
+                         int band_margin, int refresh_interval);
+int heatmap(uint8_t *src, int height, int width, int kind, uint8_t *out, int out_height,
+            int out_width);
+int carve_seam_order_ctx(sc_context *ctx, uint8_t *src, int height, int width, int num_seams,
+                         int band_margin, int refresh_interval, int32_t *order);
+void apply_seam_order(uint8_t *src, int height, int width, int32_t *order, int num_seams,
+                      uint8_t *dest);
+int carve_seams_logged(uint8_t *work, int32_t *index, int height, int width, int num_seams,
+                       int band_margin, int refresh_interval, int32_t *starts, int16_t *steps);
+int carve_seams_resume_ctx(sc_context *ctx, uint8_t *work, int32_t *index, int height, int width,
+                           int num_seams, int band_margin, int refresh_interval,
+                           sc_progress *progress, int32_t *starts, int16_t *steps);
+int replay_seams_ctx(sc_context *ctx, uint8_t *work, int32_t *index, int height, int width,
+                     int num_seams, const int32_t *starts, const int16_t *steps);
+uint8_t *carve_seams_budget_ctx(sc_context *ctx, uint8_t *src, int height, int width,
+                                int num_seams, double budget_ms, sc_budget_report *report);
+uint8_t *carve_seams_budget(uint8_t *src, int height, int width, int num_seams,
+                            double budget_ms, int32_t *report);
+double sc_flat_fraction(uint8_t *src, int height, int width);
+int sc_plan_carve(uint8_t *src, int height, int width, int num_seams, int quality,
+                  size_t memory_limit, sc_plan *plan);
+uint8_t *carve_seams_strips(uint8_t *src, int height, int width, int num_seams,
+                            int num_strips, int band_margin, int refresh_interval);
+uint8_t *carve_seams_strips_ctx(sc_context *ctx, uint8_t *src, int height, int width,
+                                int num_seams, int num_strips, int band_margin,
+                                int refresh_interval);
+int carve_seams_lanes(uint8_t **srcs, uint8_t **dests, int count, int height, int width,
+                      int num_seams);
+int carve_seams_lanes_ctx(sc_context *ctx, uint8_t **srcs, uint8_t **dests, int count,
+                          int height, int width, int num_seams);
+video_state *video_create(int height, int width, int num_seams, int band_margin);
+uint8_t *video_carve_frame(video_state *vs, uint8_t *frame);
+void video_destroy(video_state *vs);
+
+#endif